@@ -0,0 +1,1805 @@
+// Benchmarks
+// Each pattern file has a hot path worth measuring. This is one harness with one
+// suite per pattern, so they're all measured the same way and the results can be
+// compared from one run to the next.
+
+// The pattern files are notes, not code that builds, so each suite below carries
+// its own small copy of the hot path it times. Keep them in step with the notes.
+
+// What each benchmark reports:
+// 1) ns/op: wall time divided by how many operations ran. The median of several
+//    timed samples, with the fastest one alongside.
+// 2) allocations/op: how many times the general allocator was called.
+// 3) cache misses/op: from the CPU's perf counters, where the OS lets us read them.
+
+// Build with CMake (see CMakeLists.txt) and run:
+//   benchmarks [--json] [suite...]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// Counting allocations
+// Replace the global operator new and count. Only the benchmark binary does this.
+static std::atomic<long> allocations(0);
+
+void* operator new(size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void* memory = malloc(size == 0 ? 1 : size);
+  if (memory == NULL) throw std::bad_alloc();
+  return memory;
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+
+// Keeps the compiler from deciding a result is unused and deleting the work.
+template <class T>
+static void keep(const T& value)
+{
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+// Counting cache misses
+// On Linux, perf_event_open() gives us the hardware counter for the calling
+// thread. Anywhere else, or if the kernel says no (containers often do), we just
+// report nothing instead of failing the run.
+class CacheMissCounter
+{
+public:
+  CacheMissCounter()
+  : fd_(-1)
+  {
+#ifdef __linux__
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+  }
+
+  ~CacheMissCounter()
+  {
+#ifdef __linux__
+    if (fd_ != -1) close(fd_);
+#endif
+  }
+
+  bool available() const { return fd_ != -1; }
+
+  void start()
+  {
+#ifdef __linux__
+    if (fd_ == -1) return;
+    ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+  }
+
+  // -1 if the counter isn't available or couldn't be read.
+  long long stop()
+  {
+#ifdef __linux__
+    if (fd_ == -1) return -1;
+    ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+
+    long long count = 0;
+    if (read(fd_, &count, sizeof(count)) != (ssize_t)sizeof(count)) return -1;
+    return count;
+#else
+    return -1;
+#endif
+  }
+
+private:
+  int fd_;
+};
+
+// A benchmark is a name, setup that isn't timed, and a body that runs some
+// number of iterations and says how many operations that was.
+struct Benchmark
+{
+  std::string suite;
+  std::string name;
+  std::function<void()> setup;
+  std::function<long(long iterations)> run;
+  std::function<void()> teardown;
+};
+
+struct Result
+{
+  std::string suite;
+  std::string name;
+  double nsPerOp;            // Median sample.
+  double minNsPerOp;         // Fastest sample.
+  double allocationsPerOp;
+  double cacheMissesPerOp;   // Negative if counters weren't available.
+};
+
+static const int SAMPLES = 7;
+static const double MIN_SAMPLE_NS = 20e6;   // Long enough to drown out timer noise.
+
+static double now()
+{
+  return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Result measure(const Benchmark& benchmark, CacheMissCounter& misses)
+{
+  benchmark.setup();
+
+  // Find an iteration count that makes one sample long enough. This also warms
+  // caches and lets anything lazy get allocated before we start counting.
+  long iterations = 1;
+  while (true)
+  {
+    double start = now();
+    benchmark.run(iterations);
+    if (now() - start >= MIN_SAMPLE_NS || iterations >= (1L << 40)) break;
+    iterations *= 2;
+  }
+
+  std::vector<double> samples;
+  long totalOps = 0;
+  long totalAllocations = 0;
+  long long totalMisses = 0;
+  bool missesValid = misses.available();
+
+  for (int i = 0; i < SAMPLES; i++)
+  {
+    long startAllocations = allocations.load();
+    misses.start();
+    double start = now();
+
+    long ops = benchmark.run(iterations);
+
+    double elapsed = now() - start;
+    long long missCount = misses.stop();
+    totalAllocations += allocations.load() - startAllocations;
+
+    if (missCount < 0) missesValid = false;
+    else totalMisses += missCount;
+
+    // A benchmark that did nothing has no per-op cost to report.
+    if (ops <= 0) continue;
+    totalOps += ops;
+    samples.push_back(elapsed / ops);
+  }
+
+  benchmark.teardown();
+
+  Result result;
+  result.suite = benchmark.suite;
+  result.name = benchmark.name;
+  result.nsPerOp = 0;
+  result.minNsPerOp = 0;
+  result.allocationsPerOp = 0;
+  result.cacheMissesPerOp = -1;
+
+  if (!samples.empty())
+  {
+    std::sort(samples.begin(), samples.end());
+    result.nsPerOp = samples[samples.size() / 2];
+    result.minNsPerOp = samples[0];
+  }
+
+  if (totalOps > 0)
+  {
+    result.allocationsPerOp = (double)totalAllocations / totalOps;
+    if (missesValid) result.cacheMissesPerOp = (double)totalMisses / totalOps;
+  }
+
+  return result;
+}
+
+static Benchmark make(const std::string& suite, const std::string& name,
+                      std::function<void()> setup,
+                      std::function<long(long)> run,
+                      std::function<void()> teardown = [](){})
+{
+  Benchmark benchmark = { suite, name, setup, run, teardown };
+  return benchmark;
+}
+
+// Scatters objects around the heap the way a game that's been running a while
+// would, instead of in one neat run from a fresh allocator.
+template <class T>
+static std::vector<T*> scatter(std::vector<std::unique_ptr<T>>& owned, std::mt19937& random)
+{
+  std::vector<T*> pointers;
+  for (size_t i = 0; i < owned.size(); i++) pointers.push_back(owned[i].get());
+  std::shuffle(pointers.begin(), pointers.end(), random);
+  return pointers;
+}
+
+
+// ---------------------------------------------------------------------------
+// bytecode: VM::interpret() over a spell of a few hundred instructions.
+
+namespace bytecode
+{
+  enum Instruction
+  {
+    INST_SET_HEALTH      = 0x00,
+    INST_SET_WISDOM      = 0x01,
+    INST_SET_AGILITY     = 0x02,
+    INST_PLAY_SOUND      = 0x03,
+    INST_SPAWN_PARTICLES = 0x04,
+    INST_LITERAL         = 0x05,
+    INST_GET_HEALTH      = 0x06,
+    INST_GET_WISDOM      = 0x07,
+    INST_GET_AGILITY     = 0x08,
+    INST_ADD             = 0x09
+  };
+
+  struct Wizard
+  {
+    int health;
+    int wisdom;
+    int agility;
+  };
+
+  class VM
+  {
+  public:
+    VM()
+    : stackSize_(0),
+      sounds_(0),
+      particles_(0)
+    {
+      memset(wizards_, 0, sizeof(wizards_));
+    }
+
+    // Returns how many instructions ran.
+    long interpret(const char bytecode[], int size)
+    {
+      long executed = 0;
+      for (int i = 0; i < size; i++)
+      {
+        executed++;
+        char instruction = bytecode[i];
+        switch (instruction)
+        {
+          case INST_SET_HEALTH:
+          {
+            int amount = pop();
+            int wizard = pop();
+            wizards_[wizard].health = amount;
+            break;
+          }
+
+          case INST_SET_WISDOM:
+          {
+            int amount = pop();
+            int wizard = pop();
+            wizards_[wizard].wisdom = amount;
+            break;
+          }
+
+          case INST_SET_AGILITY:
+          {
+            int amount = pop();
+            int wizard = pop();
+            wizards_[wizard].agility = amount;
+            break;
+          }
+
+          case INST_PLAY_SOUND:
+            sounds_ += pop();
+            break;
+
+          case INST_SPAWN_PARTICLES:
+            particles_ += pop();
+            break;
+
+          case INST_LITERAL:
+            push(bytecode[++i]);
+            break;
+
+          case INST_GET_HEALTH:
+            push(wizards_[pop()].health);
+            break;
+
+          case INST_GET_WISDOM:
+            push(wizards_[pop()].wisdom);
+            break;
+
+          case INST_GET_AGILITY:
+            push(wizards_[pop()].agility);
+            break;
+
+          case INST_ADD:
+          {
+            int b = pop();
+            int a = pop();
+            push(a + b);
+            break;
+          }
+        }
+      }
+      return executed;
+    }
+
+    long sounds() const { return sounds_; }
+
+  private:
+    static const int MAX_STACK = 128;
+
+    void push(int value)
+    {
+      stack_[stackSize_++] = value;
+    }
+
+    int pop()
+    {
+      return stack_[--stackSize_];
+    }
+
+    int stackSize_;
+    int stack_[MAX_STACK];
+    Wizard wizards_[2];
+    long sounds_;
+    long particles_;
+  };
+
+  // A spell that mixes reads, arithmetic and writes. Values stay bounded: each
+  // write is a stat of the other wizard plus a small literal, which the next
+  // repeat overwrites.
+  std::vector<char> makeSpell()
+  {
+    std::vector<char> spell;
+    for (int repeat = 0; repeat < 16; repeat++)
+    {
+      // setHealth(0, getHealth(1) + 3)
+      const char health[] = { INST_LITERAL, 0, INST_LITERAL, 1, INST_GET_HEALTH,
+                              INST_LITERAL, 3, INST_ADD, INST_SET_HEALTH };
+      // setWisdom(1, getWisdom(0) + 1)
+      const char wisdom[] = { INST_LITERAL, 1, INST_LITERAL, 0, INST_GET_WISDOM,
+                              INST_LITERAL, 1, INST_ADD, INST_SET_WISDOM };
+      // setAgility(0, getAgility(1))
+      const char agility[] = { INST_LITERAL, 0, INST_LITERAL, 1, INST_GET_AGILITY,
+                               INST_SET_AGILITY };
+      const char effects[] = { INST_LITERAL, 2, INST_PLAY_SOUND,
+                               INST_LITERAL, 5, INST_SPAWN_PARTICLES };
+
+      spell.insert(spell.end(), health, health + sizeof(health));
+      spell.insert(spell.end(), wisdom, wisdom + sizeof(wisdom));
+      spell.insert(spell.end(), agility, agility + sizeof(agility));
+      spell.insert(spell.end(), effects, effects + sizeof(effects));
+    }
+    return spell;
+  }
+
+  void add(std::vector<Benchmark>& benchmarks)
+  {
+    auto vm = std::make_shared<VM>();
+    auto spell = std::make_shared<std::vector<char>>();
+
+    benchmarks.push_back(make("bytecode", "interpret",
+      [=]() { *spell = makeSpell(); },
+      [=](long iterations)
+      {
+        long ops = 0;
+        for (long i = 0; i < iterations; i++)
+        {
+          ops += vm->interpret(spell->data(), spell->size());
+        }
+        keep(vm->sounds());
+        return ops;
+      }));
+  }
+}
+
+
+// ---------------------------------------------------------------------------
+// observer: Subject::notify() fan-out to 10 .. 100,000 observers, for the array,
+// linked list, filtered and packed subjects. One op is one notify().
+
+namespace observer
+{
+  struct Entity
+  {
+    int id;
+  };
+
+  enum Event
+  {
+    EVENT_ENTITY_FELL,
+    EVENT_START_FALL,
+
+    NUM_EVENTS
+  };
+
+  class Observer
+  {
+  public:
+    Observer()
+    : next_(NULL)
+    {}
+
+    virtual ~Observer() {}
+    virtual void onNotify(const Entity& entity, Event event) = 0;
+
+    Observer* next_;   // For the linked list subject.
+  };
+
+  // Does just enough that the call can't be optimized away.
+  class Counter : public Observer
+  {
+  public:
+    Counter()
+    : count_(0)
+    {}
+
+    virtual void onNotify(const Entity& entity, Event event)
+    {
+      count_ += entity.id + event;
+    }
+
+  private:
+    long count_;
+  };
+
+  // The array subject, with a vector in place of MAX_OBSERVERS so it can
+  // hold 100,000.
+  class ArraySubject
+  {
+  public:
+    void addObserver(Observer* observer) { observers_.push_back(observer); }
+
+    void notify(const Entity& entity, Event event)
+    {
+      int count = observers_.size();
+      for (int i = 0; i < count; i++)
+      {
+        observers_[i]->onNotify(entity, event);
+      }
+    }
+
+  private:
+    std::vector<Observer*> observers_;
+  };
+
+  // Linked observers: the list runs through the observers themselves.
+  class ListSubject
+  {
+  public:
+    ListSubject()
+    : head_(NULL)
+    {}
+
+    void addObserver(Observer* observer)
+    {
+      observer->next_ = head_;
+      head_ = observer;
+    }
+
+    void notify(const Entity& entity, Event event)
+    {
+      for (Observer* observer = head_; observer != NULL; observer = observer->next_)
+      {
+        observer->onNotify(entity, event);
+      }
+    }
+
+  private:
+    Observer* head_;
+  };
+
+  // One list per event type.
+  class FilteredSubject
+  {
+  public:
+    void addObserver(Observer* observer, Event event)
+    {
+      observers_[event].push_back(observer);
+    }
+
+    void notify(const Entity& entity, Event event)
+    {
+      std::vector<Observer*>& list = observers_[event];
+      int count = list.size();
+      for (int i = 0; i < count; i++)
+      {
+        list[i]->onNotify(entity, event);
+      }
+    }
+
+  private:
+    std::vector<Observer*> observers_[NUM_EVENTS];
+  };
+
+  // Packed array with handles. notify() is the array walk; the handle
+  // bookkeeping is cold and kept apart.
+  class PackedSubject
+  {
+  public:
+    int addObserver(Observer* observer)
+    {
+      int slot = slots_.size();
+      slots_.push_back(observers_.size());
+      observers_.push_back(observer);
+      owners_.push_back(slot);
+      return slot;
+    }
+
+    void removeObserver(int slot)
+    {
+      int index = slots_[slot];
+      int last = observers_.size() - 1;
+      observers_[index] = observers_[last];
+      owners_[index] = owners_[last];
+      slots_[owners_[index]] = index;
+      observers_.pop_back();
+      owners_.pop_back();
+    }
+
+    void notify(const Entity& entity, Event event)
+    {
+      int count = observers_.size();
+      for (int i = 0; i < count; i++)
+      {
+        observers_[i]->onNotify(entity, event);
+      }
+    }
+
+  private:
+    std::vector<Observer*> observers_;
+    std::vector<int> owners_;
+    std::vector<int> slots_;
+  };
+
+  struct Fixture
+  {
+    std::vector<std::unique_ptr<Counter>> owned;
+    std::vector<Counter*> scattered;
+    ArraySubject array;
+    ListSubject list;
+    FilteredSubject filtered;
+    PackedSubject packed;
+  };
+
+  void add(std::vector<Benchmark>& benchmarks)
+  {
+    const int sizes[] = { 10, 100, 1000, 10000, 100000 };
+
+    for (int size : sizes)
+    {
+      auto fixture = std::make_shared<Fixture>();
+      auto setup = [=]()
+      {
+        if (!fixture->owned.empty()) return;
+
+        std::mt19937 random(size);
+        for (int i = 0; i < size; i++)
+        {
+          fixture->owned.push_back(std::unique_ptr<Counter>(new Counter()));
+        }
+        fixture->scattered = scatter(fixture->owned, random);
+
+        for (int i = 0; i < size; i++)
+        {
+          Counter* observer = fixture->scattered[i];
+          fixture->array.addObserver(observer);
+          fixture->list.addObserver(observer);
+          fixture->packed.addObserver(observer);
+
+          // Half care about falls, half about starting to fall.
+          fixture->filtered.addObserver(observer, (Event)(i % 2));
+        }
+      };
+
+      std::string suffix = "/" + std::to_string(size);
+      Entity entity = { 7 };
+
+      benchmarks.push_back(make("observer", "notify_array" + suffix, setup,
+        [=](long iterations)
+        {
+          for (long i = 0; i < iterations; i++) fixture->array.notify(entity, EVENT_ENTITY_FELL);
+          return iterations;
+        }));
+
+      benchmarks.push_back(make("observer", "notify_list" + suffix, setup,
+        [=](long iterations)
+        {
+          for (long i = 0; i < iterations; i++) fixture->list.notify(entity, EVENT_ENTITY_FELL);
+          return iterations;
+        }));
+
+      benchmarks.push_back(make("observer", "notify_filtered" + suffix, setup,
+        [=](long iterations)
+        {
+          for (long i = 0; i < iterations; i++) fixture->filtered.notify(entity, EVENT_ENTITY_FELL);
+          return iterations;
+        }));
+
+      benchmarks.push_back(make("observer", "notify_packed" + suffix, setup,
+        [=](long iterations)
+        {
+          for (long i = 0; i < iterations; i++) fixture->packed.notify(entity, EVENT_ENTITY_FELL);
+          return iterations;
+        },
+        [=]() { *fixture = Fixture(); }));
+    }
+  }
+}
+
+
+// ---------------------------------------------------------------------------
+// double_buffer: Framebuffer::clear(). One op is one full clear.
+
+namespace double_buffer
+{
+  static const char WHITE = 1;
+  static const char BLACK = 0;
+
+  class Framebuffer
+  {
+  public:
+    Framebuffer() { clear(); }
+
+    void clear()
+    {
+      for (int i = 0; i < WIDTH * HEIGHT; i++)
+      {
+        pixels_[i] = WHITE;
+      }
+    }
+
+    void draw(int x, int y)
+    {
+      pixels_[(WIDTH * y) + x] = BLACK;
+    }
+
+    const char* getPixels()
+    {
+      return pixels_;
+    }
+
+  private:
+    static const int WIDTH = 160;
+    static const int HEIGHT = 120;
+
+    char pixels_[WIDTH * HEIGHT];
+  };
+
+  void add(std::vector<Benchmark>& benchmarks)
+  {
+    auto buffer = std::make_shared<Framebuffer>();
+
+    benchmarks.push_back(make("double_buffer", "clear",
+      [](){},
+      [=](long iterations)
+      {
+        for (long i = 0; i < iterations; i++)
+        {
+          buffer->draw(i % 160, i % 120);
+          buffer->clear();
+          keep(buffer->getPixels()[0]);
+        }
+        return iterations;
+      }));
+  }
+}
+
+
+// ---------------------------------------------------------------------------
+// flyweight: World::getTile() sweeping the whole map, row by row. One op is one
+// tile lookup.
+
+namespace flyweight
+{
+  class Terrain
+  {
+  public:
+    Terrain(int movementCost, bool isWater, int texture)
+    : movementCost_(movementCost),
+      isWater_(isWater),
+      texture_(texture)
+    {}
+
+    int getMovementCost() const { return movementCost_; }
+    bool isWater() const { return isWater_; }
+
+  private:
+    int movementCost_;
+    bool isWater_;
+    int texture_;
+  };
+
+  class World
+  {
+  public:
+    static const int WIDTH = 1024;
+    static const int HEIGHT = 1024;
+
+    World()
+    : grassTerrain_(1, false, 0),
+      hillTerrain_(3, false, 1),
+      riverTerrain_(2, true, 2)
+    {}
+
+    void generateTerrain()
+    {
+      std::mt19937 random(1);
+      for (int x = 0; x < WIDTH; x++)
+      {
+        for (int y = 0; y < HEIGHT; y++)
+        {
+          tiles_[x][y] = (random() % 10 == 0) ? &hillTerrain_ : &grassTerrain_;
+        }
+      }
+
+      int x = random() % WIDTH;
+      for (int y = 0; y < HEIGHT; y++)
+      {
+        tiles_[x][y] = &riverTerrain_;
+      }
+    }
+
+    const Terrain& getTile(int x, int y) const
+    {
+      return *tiles_[x][y];
+    }
+
+  private:
+    Terrain grassTerrain_;
+    Terrain hillTerrain_;
+    Terrain riverTerrain_;
+
+    Terrain* tiles_[WIDTH][HEIGHT];
+  };
+
+  void add(std::vector<Benchmark>& benchmarks)
+  {
+    auto world = std::make_shared<std::unique_ptr<World>>();
+
+    benchmarks.push_back(make("flyweight", "get_tile_sweep",
+      [=]()
+      {
+        if (*world) return;
+        world->reset(new World());
+        (*world)->generateTerrain();
+      },
+      [=](long iterations)
+      {
+        const World& map = **world;
+        long cost = 0;
+        for (long i = 0; i < iterations; i++)
+        {
+          // x is the outer index of tiles_, so sweeping y inside walks memory in order.
+          for (int x = 0; x < World::WIDTH; x++)
+          {
+            for (int y = 0; y < World::HEIGHT; y++)
+            {
+              cost += map.getTile(x, y).getMovementCost();
+            }
+          }
+        }
+        keep(cost);
+        return iterations * World::WIDTH * World::HEIGHT;
+      },
+      [=]() { world->reset(); }));
+  }
+}
+
+
+// ---------------------------------------------------------------------------
+// prototype: Spawner::spawnMonster() with new, pooled, and batched. One op is
+// one monster spawned and later despawned.
+
+namespace prototype
+{
+  class Monster
+  {
+  public:
+    virtual ~Monster() {}
+    virtual Monster* clone() = 0;
+  };
+
+  class Ghost : public Monster
+  {
+  public:
+    Ghost(int health, int speed)
+    : health_(health),
+      speed_(speed)
+    {}
+
+    virtual Monster* clone()
+    {
+      return new Ghost(health_, speed_);
+    }
+
+  private:
+    int health_;
+    int speed_;
+  };
+
+  class Spawner
+  {
+  public:
+    Spawner(Monster* prototype)
+    : prototype_(prototype)
+    {}
+
+    Monster* spawnMonster()
+    {
+      return prototype_->clone();
+    }
+
+  private:
+    Monster* prototype_;
+  };
+
+  // The pool from Prototype.cc, reduced to one fixed block.
+  template <class T>
+  class MonsterPool
+  {
+  public:
+    MonsterPool()
+    {
+      firstFree_ = &slots_[0];
+      for (int i = 0; i < POOL_SIZE - 1; i++)
+      {
+        slots_[i].next = &slots_[i + 1];
+      }
+      slots_[POOL_SIZE - 1].next = NULL;
+    }
+
+    T* create(const T& prototype)
+    {
+      if (firstFree_ == NULL) return NULL;
+
+      Slot* slot = firstFree_;
+      firstFree_ = slot->next;
+      return new (slot->storage) T(prototype);
+    }
+
+    void destroy(T* monster)
+    {
+      monster->~T();
+
+      Slot* slot = reinterpret_cast<Slot*>(monster);
+      slot->next = firstFree_;
+      firstFree_ = slot;
+    }
+
+    static const int POOL_SIZE = 1024;
+
+  private:
+    union Slot
+    {
+      alignas(T) char storage[sizeof(T)];
+      Slot* next;
+    };
+
+    Slot slots_[POOL_SIZE];
+    Slot* firstFree_;
+  };
+
+  static const int WAVE = 1000;
+
+  void add(std::vector<Benchmark>& benchmarks)
+  {
+    benchmarks.push_back(make("prototype", "spawn_new",
+      [](){},
+      [](long iterations)
+      {
+        Ghost prototype(15, 3);
+        Spawner spawner(&prototype);
+        Monster* wave[WAVE];
+
+        for (long i = 0; i < iterations; i++)
+        {
+          for (int m = 0; m < WAVE; m++) wave[m] = spawner.spawnMonster();
+          keep(wave);
+          for (int m = 0; m < WAVE; m++) delete wave[m];
+        }
+        return iterations * WAVE;
+      }));
+
+    auto pool = std::make_shared<MonsterPool<Ghost>>();
+    benchmarks.push_back(make("prototype", "spawn_pooled",
+      [](){},
+      [=](long iterations)
+      {
+        Ghost prototype(15, 3);
+        Ghost* wave[WAVE];
+
+        for (long i = 0; i < iterations; i++)
+        {
+          for (int m = 0; m < WAVE; m++) wave[m] = pool->create(prototype);
+          keep(wave);
+          for (int m = 0; m < WAVE; m++) pool->destroy(wave[m]);
+        }
+        return iterations * WAVE;
+      }));
+
+    // The batched spawner's inner loop: one dispatch, then copies into
+    // reserved, contiguous storage.
+    auto storage = std::make_shared<std::vector<Ghost>>();
+    benchmarks.push_back(make("prototype", "spawn_batch",
+      [=]() { storage->reserve(WAVE); },
+      [=](long iterations)
+      {
+        Ghost prototype(15, 3);
+        for (long i = 0; i < iterations; i++)
+        {
+          for (int m = 0; m < WAVE; m++) storage->push_back(prototype);
+          keep(storage->data());
+          storage->clear();
+        }
+        return iterations * WAVE;
+      }));
+  }
+}
+
+
+// ---------------------------------------------------------------------------
+// state: 1024 heroines fed the same stream of inputs, through instantiated
+// state objects and through the transition table. One op is one input.
+
+namespace state
+{
+  enum Input
+  {
+    PRESS_B,
+    PRESS_DOWN,
+    RELEASE_DOWN,
+    LAND,   // Not in State.cc; gets jumping heroines back to the ground here.
+
+    NUM_INPUTS
+  };
+
+  enum State
+  {
+    STATE_STANDING,
+    STATE_JUMPING,
+    STATE_DUCKING,
+    STATE_DIVING,
+
+    NUM_STATES
+  };
+
+  // Instantiated states: handleInput() returns a new state or NULL.
+  class Heroine;
+
+  class HeroineState
+  {
+  public:
+    virtual ~HeroineState() {}
+    virtual HeroineState* handleInput(Heroine& heroine, Input input) = 0;
+  };
+
+  class Heroine
+  {
+  public:
+    Heroine();
+    ~Heroine() { delete state_; }
+
+    void handleInput(Input input)
+    {
+      HeroineState* state = state_->handleInput(*this, input);
+      if (state != NULL)
+      {
+        delete state_;
+        state_ = state;
+      }
+    }
+
+    int graphics;
+    int chargeTime;
+
+  private:
+    HeroineState* state_;
+  };
+
+  class StandingState;
+
+  class DivingState : public HeroineState
+  {
+  public:
+    virtual HeroineState* handleInput(Heroine& heroine, Input input);
+  };
+
+  class JumpingState : public HeroineState
+  {
+  public:
+    virtual HeroineState* handleInput(Heroine& heroine, Input input);
+  };
+
+  class DuckingState : public HeroineState
+  {
+  public:
+    virtual HeroineState* handleInput(Heroine& heroine, Input input);
+  };
+
+  class StandingState : public HeroineState
+  {
+  public:
+    virtual HeroineState* handleInput(Heroine& heroine, Input input)
+    {
+      if (input == PRESS_B)
+      {
+        heroine.graphics = STATE_JUMPING;
+        return new JumpingState();
+      }
+      if (input == PRESS_DOWN)
+      {
+        heroine.graphics = STATE_DUCKING;
+        heroine.chargeTime = 0;
+        return new DuckingState();
+      }
+      return NULL;
+    }
+  };
+
+  HeroineState* DivingState::handleInput(Heroine& heroine, Input input)
+  {
+    if (input == LAND)
+    {
+      heroine.graphics = STATE_STANDING;
+      return new StandingState();
+    }
+    return NULL;
+  }
+
+  HeroineState* JumpingState::handleInput(Heroine& heroine, Input input)
+  {
+    if (input == PRESS_DOWN)
+    {
+      heroine.graphics = STATE_DIVING;
+      return new DivingState();
+    }
+    if (input == LAND)
+    {
+      heroine.graphics = STATE_STANDING;
+      return new StandingState();
+    }
+    return NULL;
+  }
+
+  HeroineState* DuckingState::handleInput(Heroine& heroine, Input input)
+  {
+    if (input == RELEASE_DOWN)
+    {
+      heroine.graphics = STATE_STANDING;
+      return new StandingState();
+    }
+    return NULL;
+  }
+
+  Heroine::Heroine()
+  : graphics(STATE_STANDING),
+    chargeTime(0),
+    state_(new StandingState())
+  {}
+
+  // The table version from State.cc.
+  enum Action
+  {
+    ACTION_NONE,
+    ACTION_JUMP,
+    ACTION_DUCK,
+    ACTION_STAND,
+    ACTION_DIVE
+  };
+
+  struct Transition
+  {
+    unsigned char next;
+    unsigned char action;
+  };
+
+  struct Agent
+  {
+    unsigned char state;
+    int graphics;
+    int chargeTime;
+  };
+
+  class StateTable
+  {
+  public:
+    StateTable()
+    {
+      for (int state = 0; state < NUM_STATES; state++)
+      {
+        for (int input = 0; input < NUM_INPUTS; input++)
+        {
+          table_[state][input].next = state;
+          table_[state][input].action = ACTION_NONE;
+        }
+      }
+
+      add(STATE_STANDING, PRESS_B, STATE_JUMPING, ACTION_JUMP);
+      add(STATE_STANDING, PRESS_DOWN, STATE_DUCKING, ACTION_DUCK);
+      add(STATE_JUMPING, PRESS_DOWN, STATE_DIVING, ACTION_DIVE);
+      add(STATE_JUMPING, LAND, STATE_STANDING, ACTION_STAND);
+      add(STATE_DIVING, LAND, STATE_STANDING, ACTION_STAND);
+      add(STATE_DUCKING, RELEASE_DOWN, STATE_STANDING, ACTION_STAND);
+    }
+
+    void add(State from, Input input, State to, Action action)
+    {
+      table_[from][input].next = to;
+      table_[from][input].action = action;
+    }
+
+    const Transition& lookup(int state, Input input) const
+    {
+      return table_[state][input];
+    }
+
+  private:
+    Transition table_[NUM_STATES][NUM_INPUTS];
+  };
+
+  static void runAction(Agent& agent, Action action)
+  {
+    switch (action)
+    {
+      case ACTION_NONE:
+        break;
+
+      case ACTION_JUMP:
+        agent.graphics = STATE_JUMPING;
+        break;
+
+      case ACTION_DUCK:
+        agent.chargeTime = 0;
+        agent.graphics = STATE_DUCKING;
+        break;
+
+      case ACTION_STAND:
+        agent.graphics = STATE_STANDING;
+        break;
+
+      case ACTION_DIVE:
+        agent.graphics = STATE_DIVING;
+        break;
+    }
+  }
+
+  static const int AGENTS = 1024;
+  static const int INPUTS = 64 * 1024;
+
+  struct Fixture
+  {
+    std::vector<Input> inputs;
+    std::vector<std::unique_ptr<Heroine>> heroines;
+    std::vector<Agent> agents;
+    StateTable table;
+  };
+
+  void add(std::vector<Benchmark>& benchmarks)
+  {
+    auto fixture = std::make_shared<Fixture>();
+    auto setup = [=]()
+    {
+      if (!fixture->inputs.empty()) return;
+
+      std::mt19937 random(3);
+      for (int i = 0; i < INPUTS; i++) fixture->inputs.push_back((Input)(random() % NUM_INPUTS));
+      for (int i = 0; i < AGENTS; i++)
+      {
+        fixture->heroines.push_back(std::unique_ptr<Heroine>(new Heroine()));
+        Agent agent = { STATE_STANDING, STATE_STANDING, 0 };
+        fixture->agents.push_back(agent);
+      }
+    };
+
+    benchmarks.push_back(make("state", "transition_object", setup,
+      [=](long iterations)
+      {
+        for (long i = 0; i < iterations; i++)
+        {
+          for (int n = 0; n < INPUTS; n++)
+          {
+            fixture->heroines[n % AGENTS]->handleInput(fixture->inputs[n]);
+          }
+        }
+        return iterations * INPUTS;
+      }));
+
+    benchmarks.push_back(make("state", "transition_table", setup,
+      [=](long iterations)
+      {
+        const StateTable& table = fixture->table;
+        for (long i = 0; i < iterations; i++)
+        {
+          for (int n = 0; n < INPUTS; n++)
+          {
+            Agent& agent = fixture->agents[n % AGENTS];
+            const Transition& transition = table.lookup(agent.state, fixture->inputs[n]);
+            agent.state = transition.next;
+            runAction(agent, (Action)transition.action);
+          }
+        }
+        keep(fixture->agents[0]);
+        return iterations * INPUTS;
+      },
+      [=]() { fixture->heroines.clear(); }));
+  }
+}
+
+
+// ---------------------------------------------------------------------------
+// update: One update pass over 100,000 patrollers: virtual Skeleton, archetype
+// arrays, and the branch-free batch with SSE and AVX2. One op is one patroller
+// updated.
+
+namespace update
+{
+  class Entity
+  {
+  public:
+    virtual ~Entity() {}
+    virtual void update(double elapsed) = 0;
+  };
+
+  class Skeleton : public Entity
+  {
+  public:
+    Skeleton(double x)
+    : x(x),
+      patrollingLeft_(false)
+    {}
+
+    virtual void update(double elapsed)
+    {
+      if (patrollingLeft_)
+      {
+        x -= elapsed;
+        if (x <= 0)
+        {
+          patrollingLeft_ = false;
+          x = -x;
+        }
+      }
+      else
+      {
+        x += elapsed;
+        if (x >= 100)
+        {
+          patrollingLeft_ = true;
+          x = 100 - (x - 100);
+        }
+      }
+    }
+
+    double x;
+
+  private:
+    bool patrollingLeft_;
+  };
+
+  struct Position
+  {
+    double x;
+  };
+
+  struct Patrol
+  {
+    bool patrollingLeft;
+  };
+
+  struct PatrollerArchetype
+  {
+    std::vector<Position> positions;
+    std::vector<Patrol> patrols;
+  };
+
+  void patrolSystem(PatrollerArchetype& patrollers, double elapsed)
+  {
+    int count = patrollers.positions.size();
+    for (int i = 0; i < count; i++)
+    {
+      double& x = patrollers.positions[i].x;
+      bool& patrollingLeft = patrollers.patrols[i].patrollingLeft;
+
+      if (patrollingLeft)
+      {
+        x -= elapsed;
+        if (x <= 0)
+        {
+          patrollingLeft = false;
+          x = -x;
+        }
+      }
+      else
+      {
+        x += elapsed;
+        if (x >= 100)
+        {
+          patrollingLeft = true;
+          x = 100 - (x - 100);
+        }
+      }
+    }
+  }
+
+  struct PatrolArrays
+  {
+    float* x;
+    float* dir;
+    float* low;
+    float* high;
+    int count;
+  };
+
+  void patrolScalar(PatrolArrays& p, int begin, float elapsed)
+  {
+    for (int i = begin; i < p.count; i++)
+    {
+      float x = p.x[i] + p.dir[i] * elapsed;
+      bool underLow = x <= p.low[i];
+      bool overHigh = x >= p.high[i];
+
+      x = underLow ? 2 * p.low[i] - x : x;
+      x = overHigh ? 2 * p.high[i] - x : x;
+      p.dir[i] = underLow ? 1.0f : (overHigh ? -1.0f : p.dir[i]);
+      p.x[i] = x;
+    }
+  }
+
+#ifdef HAVE_X86_SIMD
+  static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+  {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+
+  void patrolSSE(PatrolArrays& p, float elapsed)
+  {
+    __m128 step = _mm_set1_ps(elapsed);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 plusOne = _mm_set1_ps(1.0f);
+    __m128 minusOne = _mm_set1_ps(-1.0f);
+
+    int i = 0;
+    for (; i + 4 <= p.count; i += 4)
+    {
+      __m128 dir = _mm_loadu_ps(&p.dir[i]);
+      __m128 low = _mm_loadu_ps(&p.low[i]);
+      __m128 high = _mm_loadu_ps(&p.high[i]);
+      __m128 x = _mm_add_ps(_mm_loadu_ps(&p.x[i]), _mm_mul_ps(dir, step));
+
+      __m128 underLow = _mm_cmple_ps(x, low);
+      __m128 overHigh = _mm_cmpge_ps(x, high);
+
+      x = select(underLow, _mm_sub_ps(_mm_mul_ps(two, low), x), x);
+      x = select(overHigh, _mm_sub_ps(_mm_mul_ps(two, high), x), x);
+      dir = select(underLow, plusOne, dir);
+      dir = select(overHigh, minusOne, dir);
+
+      _mm_storeu_ps(&p.x[i], x);
+      _mm_storeu_ps(&p.dir[i], dir);
+    }
+
+    patrolScalar(p, i, elapsed);
+  }
+
+  __attribute__((target("avx2")))
+  void patrolAVX2(PatrolArrays& p, float elapsed)
+  {
+    __m256 step = _mm256_set1_ps(elapsed);
+    __m256 two = _mm256_set1_ps(2.0f);
+    __m256 plusOne = _mm256_set1_ps(1.0f);
+    __m256 minusOne = _mm256_set1_ps(-1.0f);
+
+    int i = 0;
+    for (; i + 8 <= p.count; i += 8)
+    {
+      __m256 dir = _mm256_loadu_ps(&p.dir[i]);
+      __m256 low = _mm256_loadu_ps(&p.low[i]);
+      __m256 high = _mm256_loadu_ps(&p.high[i]);
+      __m256 x = _mm256_add_ps(_mm256_loadu_ps(&p.x[i]), _mm256_mul_ps(dir, step));
+
+      __m256 underLow = _mm256_cmp_ps(x, low, _CMP_LE_OQ);
+      __m256 overHigh = _mm256_cmp_ps(x, high, _CMP_GE_OQ);
+
+      x = _mm256_blendv_ps(x, _mm256_sub_ps(_mm256_mul_ps(two, low), x), underLow);
+      x = _mm256_blendv_ps(x, _mm256_sub_ps(_mm256_mul_ps(two, high), x), overHigh);
+      dir = _mm256_blendv_ps(dir, plusOne, underLow);
+      dir = _mm256_blendv_ps(dir, minusOne, overHigh);
+
+      _mm256_storeu_ps(&p.x[i], x);
+      _mm256_storeu_ps(&p.dir[i], dir);
+    }
+
+    patrolScalar(p, i, elapsed);
+  }
+#endif
+
+  static const int COUNT = 100000;
+  static const double ELAPSED = 0.7;
+
+  struct Fixture
+  {
+    std::vector<std::unique_ptr<Skeleton>> owned;
+    std::vector<Skeleton*> skeletons;
+    PatrollerArchetype archetype;
+    std::vector<float> x, dir, low, high;
+    PatrolArrays arrays;
+  };
+
+  void add(std::vector<Benchmark>& benchmarks)
+  {
+    auto fixture = std::make_shared<Fixture>();
+    auto setup = [=]()
+    {
+      if (!fixture->owned.empty()) return;
+
+      // Random starting points so the turns don't line up.
+      std::mt19937 random(4);
+      std::uniform_real_distribution<float> position(1, 99);
+      for (int i = 0; i < COUNT; i++)
+      {
+        float x = position(random);
+        bool left = random() % 2 == 0;
+
+        fixture->owned.push_back(std::unique_ptr<Skeleton>(new Skeleton(x)));
+
+        Position p = { x };
+        Patrol patrol = { left };
+        fixture->archetype.positions.push_back(p);
+        fixture->archetype.patrols.push_back(patrol);
+
+        fixture->x.push_back(x);
+        fixture->dir.push_back(left ? -1.0f : 1.0f);
+        fixture->low.push_back(0);
+        fixture->high.push_back(100);
+      }
+      fixture->skeletons = scatter(fixture->owned, random);
+
+      PatrolArrays arrays = { fixture->x.data(), fixture->dir.data(),
+                              fixture->low.data(), fixture->high.data(), COUNT };
+      fixture->arrays = arrays;
+    };
+
+    benchmarks.push_back(make("update", "virtual", setup,
+      [=](long iterations)
+      {
+        for (long i = 0; i < iterations; i++)
+        {
+          for (int n = 0; n < COUNT; n++)
+          {
+            Entity* entity = fixture->skeletons[n];
+            entity->update(ELAPSED);
+          }
+        }
+        return iterations * COUNT;
+      }));
+
+    benchmarks.push_back(make("update", "archetype", setup,
+      [=](long iterations)
+      {
+        for (long i = 0; i < iterations; i++) patrolSystem(fixture->archetype, ELAPSED);
+        return iterations * COUNT;
+      }));
+
+    benchmarks.push_back(make("update", "batch_scalar", setup,
+      [=](long iterations)
+      {
+        for (long i = 0; i < iterations; i++) patrolScalar(fixture->arrays, 0, ELAPSED);
+        return iterations * COUNT;
+      }));
+
+#ifdef HAVE_X86_SIMD
+    benchmarks.push_back(make("update", "batch_sse", setup,
+      [=](long iterations)
+      {
+        for (long i = 0; i < iterations; i++) patrolSSE(fixture->arrays, ELAPSED);
+        return iterations * COUNT;
+      }));
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+      benchmarks.push_back(make("update", "batch_avx2", setup,
+        [=](long iterations)
+        {
+          for (long i = 0; i < iterations; i++) patrolAVX2(fixture->arrays, ELAPSED);
+          return iterations * COUNT;
+        }));
+    }
+#endif
+  }
+}
+
+
+// ---------------------------------------------------------------------------
+// particles: one frame of integrate-and-kill over a million live particles,
+// SoA as in SubclassSandbox.cc next to an array of Particle structs. One op is
+// one particle updated.
+
+namespace particles
+{
+  static const int COUNT = 1000000;
+  static const float GRAVITY = 9.8f;
+
+  // Structure of arrays.
+  struct ParticlePool
+  {
+    std::vector<float> x, y, z, vx, vy, vz, life;
+    int numLive;
+
+    void resize(int capacity)
+    {
+      // Rounded up to four so the SIMD loop never needs a tail.
+      capacity = (capacity + 3) & ~3;
+      x.resize(capacity); y.resize(capacity); z.resize(capacity);
+      vx.resize(capacity); vy.resize(capacity); vz.resize(capacity);
+      life.resize(capacity);
+    }
+  };
+
+  void integrate(ParticlePool& p, float dt)
+  {
+#ifdef HAVE_X86_SIMD
+    __m128 step = _mm_set1_ps(dt);
+    __m128 gravity = _mm_set1_ps(GRAVITY * dt);
+
+    for (int i = 0; i < p.numLive; i += 4)
+    {
+      __m128 vz = _mm_sub_ps(_mm_loadu_ps(&p.vz[i]), gravity);
+      _mm_storeu_ps(&p.vz[i], vz);
+
+      _mm_storeu_ps(&p.x[i], _mm_add_ps(_mm_loadu_ps(&p.x[i]), _mm_mul_ps(_mm_loadu_ps(&p.vx[i]), step)));
+      _mm_storeu_ps(&p.y[i], _mm_add_ps(_mm_loadu_ps(&p.y[i]), _mm_mul_ps(_mm_loadu_ps(&p.vy[i]), step)));
+      _mm_storeu_ps(&p.z[i], _mm_add_ps(_mm_loadu_ps(&p.z[i]), _mm_mul_ps(vz, step)));
+      _mm_storeu_ps(&p.life[i], _mm_sub_ps(_mm_loadu_ps(&p.life[i]), step));
+    }
+#else
+    for (int i = 0; i < p.numLive; i++)
+    {
+      p.vz[i] -= GRAVITY * dt;
+      p.x[i] += p.vx[i] * dt;
+      p.y[i] += p.vy[i] * dt;
+      p.z[i] += p.vz[i] * dt;
+      p.life[i] -= dt;
+    }
+#endif
+  }
+
+  void kill(ParticlePool& p)
+  {
+    int i = 0;
+    while (i < p.numLive)
+    {
+#ifdef HAVE_X86_SIMD
+      if ((i & 3) == 0 && i + 4 <= p.numLive &&
+          _mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(&p.life[i]), _mm_setzero_ps())) == 0)
+      {
+        i += 4;
+        continue;
+      }
+#endif
+
+      if (p.life[i] > 0)
+      {
+        i++;
+        continue;
+      }
+
+      int last = --p.numLive;
+      p.x[i] = p.x[last];
+      p.y[i] = p.y[last];
+      p.z[i] = p.z[last];
+      p.vx[i] = p.vx[last];
+      p.vy[i] = p.vy[last];
+      p.vz[i] = p.vz[last];
+      p.life[i] = p.life[last];
+    }
+  }
+
+  // Array of structs, for comparison.
+  struct Particle
+  {
+    float x, y, z, vx, vy, vz, life;
+  };
+
+  void updateStructs(std::vector<Particle>& particles, int& numLive, float dt)
+  {
+    for (int i = 0; i < numLive; i++)
+    {
+      Particle& p = particles[i];
+      p.vz -= GRAVITY * dt;
+      p.x += p.vx * dt;
+      p.y += p.vy * dt;
+      p.z += p.vz * dt;
+      p.life -= dt;
+    }
+
+    int i = 0;
+    while (i < numLive)
+    {
+      if (particles[i].life > 0) i++;
+      else particles[i] = particles[--numLive];
+    }
+  }
+
+  struct Fixture
+  {
+    ParticlePool pool;
+    std::vector<Particle> structs;
+    int numStructs;
+  };
+
+  void add(std::vector<Benchmark>& benchmarks)
+  {
+    auto fixture = std::make_shared<Fixture>();
+
+    // Lifetimes long enough that everything stays alive for the whole run.
+    auto setup = [=]()
+    {
+      std::mt19937 random(5);
+      std::uniform_real_distribution<float> velocity(-1, 1);
+
+      ParticlePool& pool = fixture->pool;
+      pool.resize(COUNT);
+      pool.numLive = COUNT;
+      fixture->structs.resize(COUNT);
+      fixture->numStructs = COUNT;
+
+      for (int i = 0; i < COUNT; i++)
+      {
+        Particle p = { 0, 0, 0, velocity(random), velocity(random), velocity(random), 1e30f };
+        fixture->structs[i] = p;
+
+        pool.x[i] = p.x; pool.y[i] = p.y; pool.z[i] = p.z;
+        pool.vx[i] = p.vx; pool.vy[i] = p.vy; pool.vz[i] = p.vz;
+        pool.life[i] = p.life;
+      }
+    };
+
+    const float dt = 1.0f / 60;
+
+    benchmarks.push_back(make("particles", "soa_1m", setup,
+      [=](long iterations)
+      {
+        long ops = 0;
+        for (long i = 0; i < iterations; i++)
+        {
+          ops += fixture->pool.numLive;
+          integrate(fixture->pool, dt);
+          kill(fixture->pool);
+        }
+        return ops;
+      }));
+
+    benchmarks.push_back(make("particles", "aos_1m", setup,
+      [=](long iterations)
+      {
+        long ops = 0;
+        for (long i = 0; i < iterations; i++)
+        {
+          ops += fixture->numStructs;
+          updateStructs(fixture->structs, fixture->numStructs, dt);
+        }
+        return ops;
+      },
+      [=]()
+      {
+        fixture->pool = ParticlePool();
+        fixture->structs = std::vector<Particle>();
+      }));
+  }
+}
+
+
+// Output
+// Human-readable by default. With --json, one object per result, so a script can
+// keep the numbers from each commit and flag anything that got slower.
+void printJson(const std::vector<Result>& results)
+{
+  printf("[\n");
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const Result& r = results[i];
+    printf("  {\"suite\": \"%s\", \"name\": \"%s\", \"ns_per_op\": %.4f, "
+           "\"min_ns_per_op\": %.4f, \"allocs_per_op\": %.4f, \"cache_misses_per_op\": ",
+           r.suite.c_str(), r.name.c_str(), r.nsPerOp, r.minNsPerOp, r.allocationsPerOp);
+
+    if (r.cacheMissesPerOp < 0) printf("null");
+    else printf("%.4f", r.cacheMissesPerOp);
+
+    printf("}%s\n", i + 1 < results.size() ? "," : "");
+  }
+  printf("]\n");
+}
+
+// Usage: benchmarks [--json] [suite...]
+// With no suites named, runs all of them.
+int main(int argc, char** argv)
+{
+  bool json = false;
+  std::vector<std::string> suites;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--json") == 0) json = true;
+    else suites.push_back(argv[i]);
+  }
+
+  std::vector<Benchmark> benchmarks;
+  bytecode::add(benchmarks);
+  observer::add(benchmarks);
+  double_buffer::add(benchmarks);
+  flyweight::add(benchmarks);
+  prototype::add(benchmarks);
+  state::add(benchmarks);
+  update::add(benchmarks);
+  particles::add(benchmarks);
+
+  CacheMissCounter misses;
+  std::vector<Result> results;
+
+  for (const Benchmark& benchmark : benchmarks)
+  {
+    if (!suites.empty() &&
+        std::find(suites.begin(), suites.end(), benchmark.suite) == suites.end())
+    {
+      continue;
+    }
+
+    results.push_back(measure(benchmark, misses));
+
+    if (!json)
+    {
+      const Result& r = results.back();
+      printf("%-14s %-24s %10.3f ns/op (min %10.3f) %8.3f allocs/op", r.suite.c_str(),
+             r.name.c_str(), r.nsPerOp, r.minNsPerOp, r.allocationsPerOp);
+      if (r.cacheMissesPerOp >= 0) printf(" %8.3f misses/op", r.cacheMissesPerOp);
+      printf("\n");
+      fflush(stdout);
+    }
+  }
+
+  if (json)
+  {
+    printJson(results);
+    return 0;
+  }
+
+  if (!misses.available())
+  {
+    printf("(cache miss counters not available on this machine)\n");
+  }
+  return 0;
+}
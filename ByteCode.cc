@@ -205,4 +205,78 @@ case INST_GET_AGILITY:
 // How to make a higher-level way of authoring the bytecode?
 // Build a UI
 // Building a graphical interface to let users define their behavior, especially if the people using it won’t be highly technical. 
-// Writing text that’s free of syntax errors is difficult for people who haven’t spent years getting used to a compiler yelling at them.
\ No newline at end of file
+// Writing text that’s free of syntax errors is difficult for people who haven’t spent years getting used to a compiler yelling at them.
+
+// Reloading spells
+// Spells are already data, so reloading one is just compiling it again. The
+// catch is that a VM might be in the middle of running the old bytecode.
+// Code refers to a spell by id, and the ids index a table of programs. A reload
+// compiles the changed spell into a new program off to the side, and the table
+// entry is swapped between frames, when no VM is running.
+
+struct Program
+{
+  std::vector<char> bytecode;
+};
+
+class SpellTable
+{
+public:
+  // Reload thread. On failure the old spell keeps running and error says why.
+  bool recompile(int spell, const char* source, std::string& error)
+  {
+    if (spell < 0)
+    {
+      error = "invalid spell id " + std::to_string(spell);
+      return false;
+    }
+
+    Program* program = new Program();
+    if (!compile(source, program->bytecode, error))
+    {
+      delete program;
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(pendingLock_);
+    pending_.push_back(std::make_pair(spell, program));
+    return true;
+  }
+
+  // Game thread, between frames.
+  void swapPending()
+  {
+    std::lock_guard<std::mutex> lock(pendingLock_);
+    for (size_t i = 0; i < pending_.size(); i++)
+    {
+      int spell = pending_[i].first;
+
+      // A spell added while the game is running gets a new slot. Empty slots
+      // in between stay NULL until their spell shows up.
+      if (spell >= (int)programs_.size()) programs_.resize(spell + 1, NULL);
+
+      delete programs_[spell];
+      programs_[spell] = pending_[i].second;
+    }
+    pending_.clear();
+  }
+
+  // NULL for an id with no spell yet, including the holes swapPending() leaves
+  // when a new spell skips ahead.
+  const Program* get(int spell) const
+  {
+    if (spell < 0 || spell >= (int)programs_.size()) return NULL;
+    return programs_[spell];
+  }
+
+private:
+  std::vector<Program*> programs_;
+
+  // Only ever held for a push_back or a swap, never while compiling.
+  std::mutex pendingLock_;
+  std::vector<std::pair<int, Program*>> pending_;
+};
+
+// Since our bytecode has no calls between spells, there's nothing to relink: a
+// change to one spell never affects another. If we add a call instruction that
+// names another spell by id, it still only needs that id, so the same holds.
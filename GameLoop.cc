@@ -78,3 +78,102 @@ render(lag / MS_PER_UPDATE);
     // - more complex
 
 
+
+
+// Headless simulation
+// For servers, bots and soak tests we don't want to render at all, and we don't
+// want to wait for real time to pass either. The only thing tying the loop above
+// to the wall clock is getCurrentTime(), so make the clock something we pass in.
+
+class Clock
+{
+public:
+  virtual ~Clock() {}
+  virtual double now() = 0;
+};
+
+// The normal game uses the platform's clock.
+class SystemClock : public Clock
+{
+public:
+  virtual double now() { return getCurrentTime(); }
+};
+
+// A headless run doesn't read a clock to find out how much time passed.
+// It decides: every call to advance() is exactly one fixed step of game time.
+class SimulatedClock : public Clock
+{
+public:
+  SimulatedClock()
+  : time_(0.0)
+  {}
+
+  virtual double now() { return time_; }
+  void advance(double amount) { time_ += amount; }
+
+private:
+  double time_;
+};
+
+// The game loop from above, reading whatever clock it's given instead of
+// calling getCurrentTime() itself.
+void runGame(Clock& clock)
+{
+  double previous = clock.now();
+  double lag = 0.0;
+  while (true)
+  {
+    double current = clock.now();
+    lag += current - previous;
+    previous = current;
+
+    processInput();
+
+    while (lag >= MS_PER_UPDATE)
+    {
+      update();
+      lag -= MS_PER_UPDATE;
+    }
+
+    render(lag / MS_PER_UPDATE);
+  }
+}
+
+// The headless loop skips render() entirely and doesn't bother with lag.
+// There is nothing to catch up to, so it just runs fixed steps back to back
+// as fast as the CPU allows until the requested amount of game time has passed.
+// The wall clock is passed in too, only to report how fast it went.
+double runHeadless(SimulatedClock& simulated, Clock& wall, double gameTime)
+{
+  long ticks = 0;
+  double start = wall.now();
+
+  while (simulated.now() < gameTime)
+  {
+    processInput();
+    update();
+    simulated.advance(MS_PER_UPDATE);
+    ticks++;
+  }
+
+  // A very short run can finish inside one tick of the wall clock. Count it
+  // as one millisecond instead of dividing by zero; the rate we report is then
+  // a lower bound on the real one.
+  double realMs = wall.now() - start;
+  if (realMs < 1.0) realMs = 1.0;
+
+  // Simulated ticks per second. Divide by (1000 / MS_PER_UPDATE) to get how
+  // many times faster than real time we ran.
+  return ticks / (realMs / 1000.0);
+}
+
+// The real game and a headless soak test are then:
+//   SystemClock system;
+//   runGame(system);
+//
+//   SimulatedClock simulated;
+//   double ticksPerSecond = runHeadless(simulated, system, 60 * 60 * 1000.0);
+
+// Because update() always sees the same MS_PER_UPDATE, a headless run produces
+// the same game state as a real one given the same inputs. An hour of game time
+// is just 3600 * (1000 / MS_PER_UPDATE) calls to update().
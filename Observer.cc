@@ -111,4 +111,406 @@ void Subject::addObserver(Observer* observer)
 {
   observer->next_ = head_;
   head_ = observer;
-}
\ No newline at end of file
+}
+
+// Deferred notifications
+// notify() above is synchronous: every observer runs right there inside the
+// gameplay code that sent the event. A burst of EVENT_ENTITY_FULL events stalls
+// physics while achievements and audio do their thing.
+// Instead, notify() can just record the event in a queue that is allocated once
+// up front, and observers drain the queue at a point in the frame we choose.
+
+struct PendingEvent
+{
+  const Entity* entity;
+  Event event;
+};
+
+// Observers that want batches get all of the frame's events in one call
+// and loop over them themselves. One virtual call per observer per frame
+// instead of one per event.
+class BatchObserver
+{
+public:
+  virtual ~BatchObserver() {}
+  virtual void onNotifyBatch(const PendingEvent* events, int count) = 0;
+};
+
+class DeferredSubject
+{
+public:
+  DeferredSubject()
+  : numObservers_(0),
+    writing_(0),
+    numDropped_(0)
+  {
+    numPending_[0] = 0;
+    numPending_[1] = 0;
+  }
+
+  void addObserver(BatchObserver* observer)
+  {
+    assert(numObservers_ < MAX_OBSERVERS);
+    observers_[numObservers_++] = observer;
+  }
+
+  // Called at the point in the frame where observers should run,
+  // e.g. after physics and before render.
+  void dispatch()
+  {
+    // Swap queues before anyone runs. An observer that calls notify() from
+    // its handler writes into the other queue, so every observer sees exactly
+    // the same batch, and the new events go out on the next dispatch().
+    int reading = writing_;
+    writing_ = 1 - writing_;
+
+    for (int i = 0; i < numObservers_; i++)
+    {
+      observers_[i]->onNotifyBatch(pending_[reading], numPending_[reading]);
+    }
+    numPending_[reading] = 0;
+  }
+
+  // How many events were thrown away because a queue was full. Worth
+  // logging: it means MAX_PENDING is too small for this game.
+  int numDropped() const { return numDropped_; }
+
+protected:
+  // Cheap enough to call from the middle of physics: just a copy into the queue.
+  void notify(const Entity& entity, Event event)
+  {
+    // The queue is sized for the worst frame we expect. If a burst goes past
+    // that, drop the event rather than stall physics by dispatching here.
+    int& count = numPending_[writing_];
+    if (count == MAX_PENDING)
+    {
+      numDropped_++;
+      return;
+    }
+
+    pending_[writing_][count].entity = &entity;
+    pending_[writing_][count].event = event;
+    count++;
+  }
+
+private:
+  static const int MAX_PENDING = 1024;
+
+  BatchObserver* observers_[MAX_OBSERVERS];
+  int numObservers_;
+
+  // Two queues: one being filled by notify(), one being read by dispatch().
+  PendingEvent pending_[2][MAX_PENDING];
+  int numPending_[2];
+  int writing_;
+  int numDropped_;
+};
+
+// Achievements as a batch observer:
+class BatchAchievements : public BatchObserver
+{
+public:
+  virtual void onNotifyBatch(const PendingEvent* events, int count)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      if (events[i].event == EVENT_ENTITY_FULL &&
+          events[i].entity->isHero() && heroIsOnBridge_)
+      {
+        unlock(ACHIEVEMENT_FELL_OFF_BRIDGE);
+      }
+    }
+  }
+
+private:
+  void unlock(Achievement achievement);
+
+  bool heroIsOnBridge_;
+};
+
+// Catch: the entity pointers are only good until dispatch() runs. If an entity
+// can be destroyed between notify() and dispatch(), store an id instead.
+
+
+// Filtering by event type
+// Every observer gets every event, and Achievements throws most of them away
+// in its switch. That's a wasted virtual call per observer per event.
+// If observers say up front which events they care about, the subject can keep
+// one list per event type and notify() only walks the list for that event.
+
+class FilteredSubject
+{
+public:
+  FilteredSubject()
+  {
+    for (int i = 0; i < NUM_EVENTS; i++)
+    {
+      numObservers_[i] = 0;
+    }
+  }
+
+  void addObserver(Observer* observer, Event event)
+  {
+    assert(numObservers_[event] < MAX_OBSERVERS);
+    observers_[event][numObservers_[event]++] = observer;
+  }
+
+  void removeObserver(Observer* observer, Event event)
+  {
+    Observer** list = observers_[event];
+    for (int i = 0; i < numObservers_[event]; i++)
+    {
+      if (list[i] == observer)
+      {
+        // Order doesn't matter, so fill the hole with the last one.
+        list[i] = list[--numObservers_[event]];
+        return;
+      }
+    }
+  }
+
+protected:
+  // O(interested observers) instead of O(all observers).
+  void notify(const Entity& entity, Event event)
+  {
+    Observer** list = observers_[event];
+    for (int i = 0; i < numObservers_[event]; i++)
+    {
+      list[i]->onNotify(entity, event);
+    }
+  }
+
+private:
+  Observer* observers_[NUM_EVENTS][MAX_OBSERVERS];
+  int numObservers_[NUM_EVENTS];
+};
+
+// Achievements subscribes only to the events its switch handles:
+//   subject.addObserver(&achievements, EVENT_ENTITY_FULL);
+
+// Cost: memory for NUM_EVENTS lists. If that's too much, an alternative is a
+// bitmask of interesting events per observer, which is cheaper to store but
+// notify() still has to touch every observer to test it.
+
+
+// Notifying across threads
+// Both subjects above are single-threaded. Adding or removing an observer while
+// notify() is walking the list is undefined.
+// One way to fix that without putting a lock in notify() is copy-on-write with
+// RCU-style reclamation:
+// 1) The observer list is an immutable snapshot behind an atomic pointer.
+// 2) notify() loads the pointer and walks that snapshot. It never takes a lock.
+// 3) addObserver()/removeObserver() copy the snapshot, change the copy, and
+//    swap the pointer. Writers are rare, so they just serialize on a mutex.
+// 4) The old snapshot can't be freed until every notify() that might still be
+//    reading it has finished. That's what the epochs are for.
+
+struct ObserverList
+{
+  int count;
+  Observer* observers[MAX_OBSERVERS];
+};
+
+class ConcurrentSubject
+{
+public:
+  ConcurrentSubject()
+  : list_(new ObserverList()),
+    epoch_(0)
+  {
+    list_.load()->count = 0;
+    readers_[0] = 0;
+    readers_[1] = 0;
+  }
+
+  ~ConcurrentSubject()
+  {
+    delete list_.load();
+  }
+
+  void addObserver(Observer* observer)
+  {
+    std::lock_guard<std::mutex> lock(writeLock_);
+
+    ObserverList* old = list_.load();
+    assert(old->count < MAX_OBSERVERS);
+
+    ObserverList* copy = new ObserverList(*old);
+    copy->observers[copy->count++] = observer;
+    publish(old, copy);
+  }
+
+  void removeObserver(Observer* observer)
+  {
+    std::lock_guard<std::mutex> lock(writeLock_);
+
+    ObserverList* old = list_.load();
+    ObserverList* copy = new ObserverList(*old);
+    for (int i = 0; i < copy->count; i++)
+    {
+      if (copy->observers[i] == observer)
+      {
+        copy->observers[i] = copy->observers[--copy->count];
+        break;
+      }
+    }
+    publish(old, copy);
+  }
+
+protected:
+  void notify(const Entity& entity, Event event)
+  {
+    // Announce that we're reading in the current epoch. Re-check the epoch
+    // in case a writer flipped it between our load and our increment.
+    int epoch;
+    while (true)
+    {
+      epoch = epoch_.load();
+      readers_[epoch & 1]++;
+      if (epoch_.load() == epoch) break;
+      readers_[epoch & 1]--;
+    }
+
+    ObserverList* list = list_.load();
+    for (int i = 0; i < list->count; i++)
+    {
+      list->observers[i]->onNotify(entity, event);
+    }
+
+    readers_[epoch & 1]--;
+  }
+
+private:
+  void publish(ObserverList* old, ObserverList* copy)
+  {
+    list_.store(copy);
+
+    // Readers that started before the swap are counted under the old epoch.
+    // Flip to the new one so new readers count elsewhere, then wait for the
+    // old ones to drain before freeing the snapshot they might be holding.
+    int epoch = epoch_.load();
+    epoch_.store(epoch + 1);
+    while (readers_[epoch & 1].load() != 0)
+    {
+      std::this_thread::yield();
+    }
+
+    delete old;
+  }
+
+  std::atomic<ObserverList*> list_;
+  std::atomic<int> epoch_;
+  std::atomic<int> readers_[2];
+  std::mutex writeLock_;
+};
+
+// Consequences:
+// - An observer removed on another thread may still get an event or two from a
+//   notify() that was already in flight. Removal only promises it won't see any
+//   notify() that starts afterwards.
+// - An observer that removes itself from inside onNotify() would wait on its own
+//   read forever. Do that through the deferred queue above instead.
+// - Writers pay for a copy of the list. Fine for subscriptions that churn a few
+//   times a frame, not for thousands.
+
+// ObserverStress.cc stresses it: a few threads call addObserver() and
+// removeObserver() in a tight loop while others call notify(), and it checks
+// that no observer is called after its removeObserver() has returned. ctest
+// runs it plain and under ASan and TSan.
+
+
+// Contiguous observers with handles
+// The linked list avoids allocation, but notify() chases next_ pointers all over
+// the heap, and removing from a singly linked list means walking it to find the
+// previous node. The array version iterates nicely but is capped at MAX_OBSERVERS.
+// A packed array with handles gets both: linear iteration and O(1) removal.
+
+// addObserver() hands back a handle instead of the caller keeping the pointer.
+// The handle stays valid even though the observer moves around in the array.
+struct ObserverHandle
+{
+  int slot;
+  int generation;
+};
+
+class PackedSubject
+{
+public:
+  ObserverHandle addObserver(Observer* observer)
+  {
+    int slot;
+    if (!freeSlots_.empty())
+    {
+      slot = freeSlots_.back();
+      freeSlots_.pop_back();
+    }
+    else
+    {
+      slot = slots_.size();
+      slots_.push_back(Slot());
+      slots_[slot].generation = 0;
+    }
+
+    slots_[slot].index = observers_.size();
+    observers_.push_back(observer);
+    owners_.push_back(slot);
+
+    ObserverHandle handle = { slot, slots_[slot].generation };
+    return handle;
+  }
+
+  // O(1): move the last observer into the hole.
+  void removeObserver(ObserverHandle handle)
+  {
+    Slot& removed = slots_[handle.slot];
+
+    // Stale handle, already removed.
+    if (removed.generation != handle.generation) return;
+
+    int index = removed.index;
+    int last = observers_.size() - 1;
+
+    observers_[index] = observers_[last];
+    owners_[index] = owners_[last];
+    slots_[owners_[index]].index = index;
+
+    observers_.pop_back();
+    owners_.pop_back();
+
+    removed.generation++;
+    freeSlots_.push_back(handle.slot);
+  }
+
+protected:
+  void notify(const Entity& entity, Event event)
+  {
+    for (size_t i = 0; i < observers_.size(); i++)
+    {
+      observers_[i]->onNotify(entity, event);
+    }
+  }
+
+private:
+  struct Slot
+  {
+    int index;
+    int generation;
+  };
+
+  // Hot: what notify() walks.
+  std::vector<Observer*> observers_;
+
+  // Cold: only touched when adding or removing.
+  std::vector<int> owners_;      // owners_[i] is the slot pointing at observers_[i].
+  std::vector<Slot> slots_;
+  std::vector<int> freeSlots_;
+};
+
+// Swap-remove means observers are no longer notified in the order they were
+// added. Nothing above relied on that, but it's worth knowing.
+
+// Comparing against the linked list: build each subject with 10, 100, ...,
+// 100,000 observers allocated in a shuffled order (so the list's nodes are
+// scattered like they would be in a real game), call notify() a few thousand
+// times and divide. The pointers are still chased inside onNotify(), but the
+// walk itself no longer waits on a cache miss to learn where the next one is.
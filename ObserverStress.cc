@@ -0,0 +1,269 @@
+// Observer stress test
+// Churns subscriptions on the copy-on-write subject from Observer.cc while other
+// threads notify through it. CMake builds it plain and, where the compiler has
+// them, under AddressSanitizer and ThreadSanitizer; ctest runs every variant.
+
+// Like Benchmarks.cc, this carries its own copy of the code it tests, since
+// Observer.cc is notes and doesn't build. Keep ConcurrentSubject in step with it.
+
+// What it checks:
+// 1) No observer is called after its removeObserver() has returned. Each
+//    churning thread deletes its observer right after removing it, so a
+//    violation is also a use-after-free that ASan reports.
+// 2) Every snapshot a notify() walks is still alive (ASan), and the epoch
+//    counting has no data races (TSan).
+// 3) Every notify() reaches the observer that stays subscribed throughout,
+//    however the rest of the list churns around it.
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Entity
+{
+  int id;
+};
+
+enum Event
+{
+  EVENT_ENTITY_FELL,
+  EVENT_ENTITY_FULL
+};
+
+class Observer
+{
+public:
+  virtual ~Observer() {}
+  virtual void onNotify(const Entity& entity, Event event) = 0;
+};
+
+static const int MAX_OBSERVERS = 64;
+
+// ---------------------------------------------------------------------------
+// Copied from Observer.cc.
+
+struct ObserverList
+{
+  int count;
+  Observer* observers[MAX_OBSERVERS];
+};
+
+class ConcurrentSubject
+{
+public:
+  ConcurrentSubject()
+  : list_(new ObserverList()),
+    epoch_(0)
+  {
+    list_.load()->count = 0;
+    readers_[0] = 0;
+    readers_[1] = 0;
+  }
+
+  ~ConcurrentSubject()
+  {
+    delete list_.load();
+  }
+
+  void addObserver(Observer* observer)
+  {
+    std::lock_guard<std::mutex> lock(writeLock_);
+
+    ObserverList* old = list_.load();
+    assert(old->count < MAX_OBSERVERS);
+
+    ObserverList* copy = new ObserverList(*old);
+    copy->observers[copy->count++] = observer;
+    publish(old, copy);
+  }
+
+  void removeObserver(Observer* observer)
+  {
+    std::lock_guard<std::mutex> lock(writeLock_);
+
+    ObserverList* old = list_.load();
+    ObserverList* copy = new ObserverList(*old);
+    for (int i = 0; i < copy->count; i++)
+    {
+      if (copy->observers[i] == observer)
+      {
+        copy->observers[i] = copy->observers[--copy->count];
+        break;
+      }
+    }
+    publish(old, copy);
+  }
+
+protected:
+  void notify(const Entity& entity, Event event)
+  {
+    // Announce that we're reading in the current epoch. Re-check the epoch
+    // in case a writer flipped it between our load and our increment.
+    int epoch;
+    while (true)
+    {
+      epoch = epoch_.load();
+      readers_[epoch & 1]++;
+      if (epoch_.load() == epoch) break;
+      readers_[epoch & 1]--;
+    }
+
+    ObserverList* list = list_.load();
+    for (int i = 0; i < list->count; i++)
+    {
+      list->observers[i]->onNotify(entity, event);
+    }
+
+    readers_[epoch & 1]--;
+  }
+
+private:
+  void publish(ObserverList* old, ObserverList* copy)
+  {
+    list_.store(copy);
+
+    // Readers that started before the swap are counted under the old epoch.
+    // Flip to the new one so new readers count elsewhere, then wait for the
+    // old ones to drain before freeing the snapshot they might be holding.
+    int epoch = epoch_.load();
+    epoch_.store(epoch + 1);
+    while (readers_[epoch & 1].load() != 0)
+    {
+      std::this_thread::yield();
+    }
+
+    delete old;
+  }
+
+  std::atomic<ObserverList*> list_;
+  std::atomic<int> epoch_;
+  std::atomic<int> readers_[2];
+  std::mutex writeLock_;
+};
+
+// ---------------------------------------------------------------------------
+
+// notify() is protected on the real subject, where gameplay code derives from it.
+class TestSubject : public ConcurrentSubject
+{
+public:
+  void send(const Entity& entity, Event event) { notify(entity, event); }
+};
+
+static std::atomic<long> lateCalls(0);
+static std::atomic<long> deliveries(0);
+
+class ChurnObserver : public Observer
+{
+public:
+  ChurnObserver()
+  : removed(false)
+  {}
+
+  virtual void onNotify(const Entity& entity, Event event)
+  {
+    if (removed.load()) lateCalls++;
+    deliveries++;
+  }
+
+  std::atomic<bool> removed;
+};
+
+// Each churning thread keeps a few observers live at once so the list has
+// something in it, and replaces the oldest one each round. Churning goes on
+// until the notifiers are done, so the run is bounded by the notifies: a
+// writer on a busy or single-core machine gets fewer rounds, not a longer run.
+static const int NOTIFIERS = 4;
+static const int CHURNERS = 4;
+static const int LIVE_PER_CHURNER = 8;
+static const long NOTIFIES_PER_THREAD = 200000;
+static const int MIN_ROUNDS = 100;
+
+// One more for the observer that stays subscribed the whole run.
+static_assert(CHURNERS * (LIVE_PER_CHURNER + 1) + 1 <= MAX_OBSERVERS,
+              "churners would overflow the list");
+
+static void churn(TestSubject& subject, std::atomic<int>& notifiersLeft,
+                  std::atomic<long>& rounds)
+{
+  std::vector<ChurnObserver*> live;
+  for (int round = 0; round < MIN_ROUNDS || notifiersLeft.load() > 0; round++)
+  {
+    ChurnObserver* observer = new ChurnObserver();
+    subject.addObserver(observer);
+    live.push_back(observer);
+
+    if ((int)live.size() > LIVE_PER_CHURNER)
+    {
+      ChurnObserver* oldest = live.front();
+      live.erase(live.begin());
+
+      subject.removeObserver(oldest);
+      oldest->removed = true;
+      delete oldest;
+    }
+    rounds++;
+  }
+
+  for (size_t i = 0; i < live.size(); i++)
+  {
+    subject.removeObserver(live[i]);
+    live[i]->removed = true;
+    delete live[i];
+  }
+}
+
+int main()
+{
+  TestSubject subject;
+  std::atomic<int> notifiersLeft(NOTIFIERS);
+  std::atomic<long> rounds(0);
+
+  // Always subscribed, so every notify() has someone to reach even if the
+  // churners haven't added anything yet.
+  ChurnObserver anchor;
+  subject.addObserver(&anchor);
+
+  std::vector<std::thread> churners;
+  for (int i = 0; i < CHURNERS; i++)
+  {
+    churners.push_back(std::thread(churn, std::ref(subject), std::ref(notifiersLeft),
+                                   std::ref(rounds)));
+  }
+
+  std::vector<std::thread> notifiers;
+  for (int i = 0; i < NOTIFIERS; i++)
+  {
+    notifiers.push_back(std::thread([&subject, &notifiersLeft, i]()
+    {
+      Entity entity = { i };
+      for (long n = 0; n < NOTIFIES_PER_THREAD; n++)
+      {
+        subject.send(entity, (Event)(n % 2));
+      }
+      notifiersLeft--;
+    }));
+  }
+
+  for (size_t i = 0; i < notifiers.size(); i++) notifiers[i].join();
+  for (size_t i = 0; i < churners.size(); i++) churners[i].join();
+  subject.removeObserver(&anchor);
+
+  printf("%ld notifies, %ld churn rounds, %ld deliveries, %ld after removal\n",
+         NOTIFIERS * NOTIFIES_PER_THREAD, rounds.load(), deliveries.load(), lateCalls.load());
+
+  if (lateCalls != 0)
+  {
+    printf("FAIL: observers were notified after removeObserver() returned\n");
+    return 1;
+  }
+  if (deliveries < NOTIFIERS * NOTIFIES_PER_THREAD)
+  {
+    printf("FAIL: some notify() calls didn't reach the subscribed observer\n");
+    return 1;
+  }
+  return 0;
+}
@@ -135,4 +135,897 @@ Spawner* ghostSpawner = new SpawnerFor<Ghost>();
   "name": "goblin archer",
   "prototype": "goblin grunt",
   "attacks": ["short bow"]
-}
\ No newline at end of file
+}
+
+// Spawning without the allocator
+// Every spawner above calls new, so a wave of monsters means a wave of heap
+// allocations scattered all over memory.
+// Instead, give each monster type a pool of its own. Dead monsters go on a free
+// list and the next spawn reuses their slot in place.
+
+// A pooled spawner needs its monsters back, so the spawner interface grows a
+// despawn(). Spawners that new their monsters just delete them.
+class Spawner
+{
+public:
+  virtual ~Spawner() {}
+
+  // Returns NULL only if the spawner was explicitly set up to refuse when it
+  // runs out of room (POOL_REFUSE below). Otherwise it always spawns.
+  virtual Monster* spawnMonster() = 0;
+
+  // Takes back a monster this spawner spawned.
+  virtual void despawn(Monster* monster) { delete monster; }
+};
+
+// What to do when every slot is in use. Either way it's a choice made when the
+// pool is set up, not something gameplay code discovers.
+enum PoolFullPolicy
+{
+  // Allocate another block of slots. Hits the allocator, but only when a wave
+  // is bigger than planned. numBlocks() going up is worth logging.
+  POOL_GROW,
+
+  // Spawn nothing and return NULL. For things like debris, where missing a
+  // few is better than ever allocating.
+  POOL_REFUSE
+};
+
+template <class T>
+class MonsterPool
+{
+public:
+  MonsterPool(PoolFullPolicy policy)
+  : policy_(policy),
+    firstFree_(NULL)
+  {
+    addBlock();
+  }
+
+  ~MonsterPool()
+  {
+    // Monsters still alive at shutdown are the owner's problem; we only
+    // return the memory.
+    for (size_t i = 0; i < blocks_.size(); i++) delete [] blocks_[i];
+  }
+
+  // Placement new into a dead slot.
+  T* create(const T& prototype)
+  {
+    if (firstFree_ == NULL)
+    {
+      if (policy_ == POOL_REFUSE) return NULL;
+      addBlock();
+    }
+
+    Slot* slot = firstFree_;
+    firstFree_ = slot->next;
+    return new (slot->storage) T(prototype);
+  }
+
+  void destroy(T* monster)
+  {
+    monster->~T();
+
+    Slot* slot = reinterpret_cast<Slot*>(monster);
+    slot->next = firstFree_;
+    firstFree_ = slot;
+  }
+
+  // Whether a monster lives in one of our blocks.
+  bool owns(const T* monster) const
+  {
+    const char* address = reinterpret_cast<const char*>(monster);
+    for (size_t i = 0; i < blocks_.size(); i++)
+    {
+      const char* begin = reinterpret_cast<const char*>(blocks_[i]);
+      if (address >= begin && address < begin + sizeof(Slot) * BLOCK_SIZE) return true;
+    }
+    return false;
+  }
+
+  int numBlocks() const { return blocks_.size(); }
+
+private:
+  static const int BLOCK_SIZE = 1024;
+
+  // A live slot holds a monster. A dead slot only needs the free list pointer,
+  // so they share the memory.
+  union Slot
+  {
+    alignas(T) char storage[sizeof(T)];
+    Slot* next;
+  };
+
+  // Each block is contiguous, and only allocated at setup or under POOL_GROW.
+  void addBlock()
+  {
+    Slot* block = new Slot[BLOCK_SIZE];
+    for (int i = 0; i < BLOCK_SIZE - 1; i++)
+    {
+      block[i].next = &block[i + 1];
+    }
+    block[BLOCK_SIZE - 1].next = firstFree_;
+    firstFree_ = &block[0];
+    blocks_.push_back(block);
+  }
+
+  PoolFullPolicy policy_;
+  std::vector<Slot*> blocks_;
+  Slot* firstFree_;
+};
+
+// The spawner copies its prototype into the pool instead of calling clone().
+// Copying is exactly what clone() did, just without new.
+template <class T>
+class PooledSpawner : public Spawner
+{
+public:
+  PooledSpawner(const T& prototype, MonsterPool<T>& pool)
+  : prototype_(prototype),
+    pool_(pool)
+  {}
+
+  virtual Monster* spawnMonster() { return pool_.create(prototype_); }
+
+  // Callers only have a Monster*. Every monster this spawner made is a T
+  // from our pool, so anything else is a bug in the caller.
+  virtual void despawn(Monster* monster)
+  {
+    T* pooled = static_cast<T*>(monster);
+    assert(pool_.owns(pooled));
+    pool_.destroy(pooled);
+  }
+
+private:
+  T prototype_;
+  MonsterPool<T>& pool_;
+};
+
+// The pools are created before gameplay starts:
+MonsterPool<Ghost> ghostPool(POOL_GROW);
+Spawner* ghostSpawner = new PooledSpawner<Ghost>(Ghost(15, 3), ghostPool);
+
+// Every Ghost now lives in one contiguous block, and as long as the first
+// block is big enough, spawning or killing one during a wave never touches the
+// general allocator. Gameplay code that holds a Spawner* returns a dead
+// monster with ghostSpawner->despawn(monster), whichever kind of spawner it is.
+
+
+// Spawning a whole wave at once
+// spawnMonster() is one virtual call per monster. A wave of thousands pays for
+// thousands of dispatches that all go to the same place.
+// A batched spawn does the dispatch once, then copies the prototype in a plain
+// loop into storage that's contiguous for that wave.
+
+// A run of monsters of one concrete type. We can't hand back a Monster*
+// and index it, since the elements are sizeof(T) apart, not sizeof(Monster).
+// So the range keeps a T* (as void*) and a small function that knows T, does
+// the indexing, and converts to Monster* with a proper static_cast.
+class MonsterRange
+{
+public:
+  typedef Monster* (*ElementFn)(void* first, int index);
+
+  MonsterRange()
+  : first_(NULL),
+    count_(0),
+    element_(NULL)
+  {}
+
+  MonsterRange(void* first, int count, ElementFn element)
+  : first_(first),
+    count_(count),
+    element_(element)
+  {}
+
+  int size() const { return count_; }
+
+  Monster& operator[](int index)
+  {
+    assert(index >= 0 && index < count_);
+    return *element_(first_, index);
+  }
+
+private:
+  void* first_;
+  int count_;
+  ElementFn element_;
+};
+
+// Optional per-instance overrides. Any array left NULL keeps the prototype's value.
+struct SpawnOverrides
+{
+  const Vector* positions;
+};
+
+class BatchSpawner
+{
+public:
+  virtual ~BatchSpawner() {}
+
+  // Spawns up to count monsters. If that would go past the capacity the
+  // spawner was created with, it spawns as many as fit; check size() on the
+  // returned range.
+  virtual MonsterRange spawnMonsters(int count,
+                                     const SpawnOverrides* overrides = NULL) = 0;
+
+  // Takes back one monster. Its slot isn't reused on its own, but once every
+  // monster from the storage is dead, the storage starts over from the front.
+  virtual void despawn(Monster* monster) = 0;
+
+  // Ends the wave: despawns everything at once. Every range handed out
+  // before this is invalid afterwards.
+  virtual void despawnAll() = 0;
+};
+
+template <class T>
+class BatchSpawnerFor : public BatchSpawner
+{
+public:
+  BatchSpawnerFor(const T& prototype, int capacity)
+  : prototype_(prototype),
+    numLive_(0)
+  {
+    // Reserved up front, and never grown past, so spawning never reallocates
+    // and moves monsters that earlier ranges point to.
+    monsters_.reserve(capacity);
+    alive_.reserve(capacity);
+  }
+
+  virtual MonsterRange spawnMonsters(int count, const SpawnOverrides* overrides)
+  {
+    int room = monsters_.capacity() - monsters_.size();
+    if (count > room) count = room;
+    if (count <= 0) return MonsterRange();
+
+    int first = monsters_.size();
+    for (int i = 0; i < count; i++)
+    {
+      monsters_.push_back(prototype_);
+      alive_.push_back(true);
+    }
+    numLive_ += count;
+
+    if (overrides != NULL && overrides->positions != NULL)
+    {
+      for (int i = 0; i < count; i++)
+      {
+        monsters_[first + i].setPosition(overrides->positions[i]);
+      }
+    }
+
+    return MonsterRange(monsters_.data() + first, count, &element);
+  }
+
+  virtual void despawn(Monster* monster)
+  {
+    int index = static_cast<T*>(monster) - monsters_.data();
+    assert(index >= 0 && index < (int)monsters_.size());
+    if (!alive_[index]) return;
+
+    alive_[index] = false;
+    if (--numLive_ == 0) despawnAll();
+  }
+
+  virtual void despawnAll()
+  {
+    // clear() keeps the capacity, so the next wave doesn't allocate either.
+    monsters_.clear();
+    alive_.clear();
+    numLive_ = 0;
+  }
+
+private:
+  static Monster* element(void* first, int index)
+  {
+    return static_cast<Monster*>(static_cast<T*>(first) + index);
+  }
+
+  T prototype_;
+  std::vector<T> monsters_;
+  std::vector<bool> alive_;
+  int numLive_;
+};
+
+// Spawning a wave of ghosts is now one call:
+BatchSpawner* ghostWave = new BatchSpawnerFor<Ghost>(Ghost(15, 3), 4096);
+MonsterRange ghosts = ghostWave->spawnMonsters(1000);
+
+// Since the loop knows the concrete type, the compiler can turn the copy into
+// straight memory copies. Ghost is two ints plus a vtable pointer.
+
+
+// Loading the data
+// The records above delegate to their prototype at runtime, which means every
+// lookup of "minHealth" on a goblin wizard walks up to the goblin grunt.
+// Since the data doesn't change while the game runs, we can do that walk once
+// at load time and flatten each record into a fully resolved copy.
+
+// A resolved record. Plain data so it can be written to disk and read back
+// as-is. Lists are stored as bitmasks of known names.
+struct MonsterRecord
+{
+  char name[32];
+  int minHealth;
+  int maxHealth;
+  unsigned int resists;     // One bit per element: cold, poison, fire, ...
+  unsigned int weaknesses;
+  unsigned int spells;
+  unsigned int attacks;
+};
+
+// Field presence for a record still being resolved, so we know what to inherit.
+enum
+{
+  HAS_MIN_HEALTH = 1 << 0,
+  HAS_MAX_HEALTH = 1 << 1,
+  HAS_RESISTS    = 1 << 2,
+  HAS_WEAKNESSES = 1 << 3,
+  HAS_SPELLS     = 1 << 4,
+  HAS_ATTACKS    = 1 << 5
+};
+
+struct RawRecord
+{
+  MonsterRecord record;    // Filled in from the prototype once resolved.
+  int fields;
+  std::string prototype;   // Empty if none.
+  bool resolving;
+  bool resolved;
+
+  // The record exactly as it appeared in the file, and which fields it set
+  // itself. Kept so a reload can throw away what was inherited and inherit again.
+  MonsterRecord own;
+  int ownFields;
+};
+
+// Data mistakes are reported, not asserted: they come from designers editing
+// files, and a release build has to say what's wrong instead of crashing.
+class MonsterLoader
+{
+public:
+  // One record as parsed from the JSON.
+  bool add(const RawRecord& raw, std::string& error)
+  {
+    std::string name = raw.record.name;
+    if (raw_.find(name) != raw_.end())
+    {
+      error = "duplicate monster '" + name + "'";
+      return false;
+    }
+
+    RawRecord& added = raw_[name] = raw;
+    added.own = raw.record;
+    added.ownFields = raw.fields;
+    added.resolving = false;
+    added.resolved = false;
+    linkChild(added.prototype, name);
+    return true;
+  }
+
+  // Reloading: replaces the changed records and re-resolves only them and what
+  // inherits from them. Everything else keeps its resolved copy.
+  //
+  // The changes go into a scratch copy first, which only replaces ours if it
+  // all resolves. A bad edit leaves the loader exactly as it was, so the reload
+  // that fixes it starts from clean, resolved records.
+  bool reloadRecords(const std::vector<RawRecord>& changed, std::string& error)
+  {
+    MonsterLoader scratch = *this;
+    if (!scratch.replaceRecords(changed, error)) return false;
+
+    raw_.swap(scratch.raw_);
+    children_.swap(scratch.children_);
+    return true;
+  }
+
+  // Fills each record's missing fields from its prototype, resolving the
+  // prototype first. Each record is visited once, so the whole set is linear.
+  bool resolveAll(std::string& error)
+  {
+    for (auto& entry : raw_)
+    {
+      if (!resolve(entry.second, error)) return false;
+    }
+    return true;
+  }
+
+  // The flattened records, ready for MonsterDatabase::build().
+  std::vector<MonsterRecord> records() const
+  {
+    std::vector<MonsterRecord> records;
+    for (const auto& entry : raw_) records.push_back(entry.second.record);
+    return records;
+  }
+
+private:
+  bool replaceRecords(const std::vector<RawRecord>& changed, std::string& error)
+  {
+    std::vector<std::string> dirty;
+    for (size_t i = 0; i < changed.size(); i++)
+    {
+      std::string name = changed[i].record.name;
+
+      auto existing = raw_.find(name);
+      bool isNew = existing == raw_.end();
+      if (!isNew)
+      {
+        // Mark before replacing: markDirty() only follows records that are
+        // still resolved, and the replacement isn't.
+        markDirty(name, dirty);
+        unlinkChild(existing->second.prototype, name);
+      }
+
+      RawRecord& raw = raw_[name] = changed[i];
+      raw.own = raw.record;
+      raw.ownFields = raw.fields;
+      raw.resolving = false;
+      raw.resolved = false;
+
+      // Its "prototype" may have changed, so its place in children_ may too.
+      linkChild(raw.prototype, name);
+
+      if (isNew) dirty.push_back(name);
+    }
+
+    for (size_t i = 0; i < dirty.size(); i++)
+    {
+      if (!resolve(raw_[dirty[i]], error)) return false;
+    }
+    return true;
+  }
+
+  bool resolve(RawRecord& raw, std::string& error)
+  {
+    if (raw.resolved) return true;
+
+    // Reaching a record we're already in the middle of resolving means the
+    // chain loops, like "goblin grunt" -> "goblin wizard" -> "goblin grunt".
+    if (raw.resolving)
+    {
+      error = "prototype cycle through '" + std::string(raw.record.name) + "'";
+      return false;
+    }
+    raw.resolving = true;
+
+    if (!raw.prototype.empty())
+    {
+      // find(), not operator[]: a misspelled prototype shouldn't quietly
+      // create an empty record and inherit zeros from it.
+      auto parent = raw_.find(raw.prototype);
+      if (parent == raw_.end())
+      {
+        error = "'" + std::string(raw.record.name) +
+                "' has unknown prototype '" + raw.prototype + "'";
+        raw.resolving = false;
+        return false;
+      }
+
+      if (!resolve(parent->second, error))
+      {
+        raw.resolving = false;
+        return false;
+      }
+      inherit(raw, parent->second);
+    }
+
+    raw.resolving = false;
+    raw.resolved = true;
+    return true;
+  }
+
+  void inherit(RawRecord& child, const RawRecord& parent)
+  {
+    const MonsterRecord& from = parent.record;
+    MonsterRecord& to = child.record;
+
+    if (!(child.fields & HAS_MIN_HEALTH)) to.minHealth = from.minHealth;
+    if (!(child.fields & HAS_MAX_HEALTH)) to.maxHealth = from.maxHealth;
+    if (!(child.fields & HAS_RESISTS))    to.resists = from.resists;
+    if (!(child.fields & HAS_WEAKNESSES)) to.weaknesses = from.weaknesses;
+    if (!(child.fields & HAS_SPELLS))     to.spells = from.spells;
+    if (!(child.fields & HAS_ATTACKS))    to.attacks = from.attacks;
+
+    child.fields |= parent.fields;
+  }
+
+  void linkChild(const std::string& prototype, const std::string& name)
+  {
+    if (!prototype.empty()) children_[prototype].push_back(name);
+  }
+
+  void unlinkChild(const std::string& prototype, const std::string& name)
+  {
+    auto found = children_.find(prototype);
+    if (found == children_.end()) return;
+
+    std::vector<std::string>& children = found->second;
+    children.erase(std::remove(children.begin(), children.end(), name), children.end());
+  }
+
+  // Puts a resolved record back to just what it set itself, so it inherits
+  // new values instead of keeping old ones, then does the same for everything
+  // that inherits from it.
+  void markDirty(const std::string& name, std::vector<std::string>& dirty)
+  {
+    auto found = raw_.find(name);
+    if (found == raw_.end()) return;
+
+    RawRecord& raw = found->second;
+    if (!raw.resolved) return;   // Already marked.
+
+    raw.record = raw.own;
+    raw.fields = raw.ownFields;
+    raw.resolved = false;
+    dirty.push_back(name);
+
+    auto children = children_.find(name);
+    if (children == children_.end()) return;
+
+    for (size_t i = 0; i < children->second.size(); i++)
+    {
+      markDirty(children->second[i], dirty);
+    }
+  }
+
+  std::unordered_map<std::string, RawRecord> raw_;
+
+  // For each record, the records that name it as their prototype.
+  std::unordered_map<std::string, std::vector<std::string>> children_;
+};
+
+// Once resolved, the records are written to a binary cache:
+//
+//   [CacheHeader]
+//   [MonsterRecord x numRecords]
+//   [index: int x indexSize]
+//
+// The index is an open-addressed hash table of record numbers, keyed by the
+// FNV-1a hash of the name, with -1 for empty buckets. On a warm start we check
+// the cache's source timestamp against the JSON files and, if nothing changed,
+// read the file straight into memory. No parsing, no resolving.
+
+static const unsigned int MONSTER_CACHE_MAGIC = 0x534e4f4d;   // "MONS"
+static const unsigned int MONSTER_CACHE_VERSION = 1;          // Bump when MonsterRecord changes.
+
+struct CacheHeader
+{
+  unsigned int magic;
+  unsigned int version;
+  long long sourceTime;   // Newest modification time of the JSON files.
+  int numRecords;
+  int indexSize;
+};
+
+class MonsterDatabase
+{
+public:
+  MonsterDatabase() {}
+
+  // Cold start: build from freshly resolved records.
+  void build(const std::vector<MonsterRecord>& records)
+  {
+    records_ = records;
+
+    // Keep the table at most half full so probes stay short.
+    int size = 1;
+    while (size < (int)records_.size() * 2) size *= 2;
+    index_.assign(size, -1);
+
+    for (int i = 0; i < (int)records_.size(); i++)
+    {
+      unsigned int bucket = hash(records_[i].name) & (size - 1);
+      while (index_[bucket] != -1) bucket = (bucket + 1) & (size - 1);
+      index_[bucket] = i;
+    }
+  }
+
+  bool save(const char* path, long long sourceTime) const
+  {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return false;
+
+    CacheHeader header;
+    header.magic = MONSTER_CACHE_MAGIC;
+    header.version = MONSTER_CACHE_VERSION;
+    header.sourceTime = sourceTime;
+    header.numRecords = records_.size();
+    header.indexSize = index_.size();
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(records_.data(), sizeof(MonsterRecord), records_.size(), file) == records_.size() &&
+              fwrite(index_.data(), sizeof(int), index_.size(), file) == index_.size();
+
+    return fclose(file) == 0 && ok;
+  }
+
+  // Warm start. Returns false if the cache is missing, from another version,
+  // older than the JSON, or damaged; the caller then loads the JSON and
+  // writes a fresh cache.
+  bool load(const char* path, long long sourceTime)
+  {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    // The index needs at least one empty bucket, or find() on a missing name
+    // never stops probing. And the counts have to fit in what's actually in
+    // the file before we size anything from them.
+    CacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              header.magic == MONSTER_CACHE_MAGIC &&
+              header.version == MONSTER_CACHE_VERSION &&
+              header.sourceTime == sourceTime &&
+              header.numRecords >= 0 &&
+              header.indexSize > header.numRecords &&
+              (header.indexSize & (header.indexSize - 1)) == 0 &&
+              fseek(file, 0, SEEK_END) == 0 &&
+              ftell(file) == (long)(sizeof(CacheHeader) +
+                                    header.numRecords * sizeof(MonsterRecord) +
+                                    header.indexSize * sizeof(int)) &&
+              fseek(file, sizeof(CacheHeader), SEEK_SET) == 0;
+
+    if (ok)
+    {
+      records_.resize(header.numRecords);
+      index_.resize(header.indexSize);
+      ok = fread(records_.data(), sizeof(MonsterRecord), records_.size(), file) == records_.size() &&
+           fread(index_.data(), sizeof(int), index_.size(), file) == index_.size();
+    }
+    fclose(file);
+
+    // Don't trust the file further than we have to. A bigger index can still
+    // be full if entries repeat, so look for the empty bucket too.
+    bool hasEmpty = false;
+    for (size_t i = 0; ok && i < index_.size(); i++)
+    {
+      ok = index_[i] >= -1 && index_[i] < header.numRecords;
+      if (index_[i] == -1) hasEmpty = true;
+    }
+    ok = ok && hasEmpty;
+    for (size_t i = 0; ok && i < records_.size(); i++)
+    {
+      records_[i].name[sizeof(records_[i].name) - 1] = '\0';
+    }
+
+    if (!ok)
+    {
+      records_.clear();
+      index_.clear();
+    }
+    return ok;
+  }
+
+  const MonsterRecord* find(const char* name) const
+  {
+    if (index_.empty()) return NULL;
+
+    unsigned int mask = index_.size() - 1;   // The size is a power of two.
+    unsigned int bucket = hash(name) & mask;
+
+    while (index_[bucket] != -1)
+    {
+      const MonsterRecord& record = records_[index_[bucket]];
+      if (strcmp(record.name, name) == 0) return &record;
+      bucket = (bucket + 1) & mask;
+    }
+
+    return NULL;
+  }
+
+private:
+  static unsigned int hash(const char* name)
+  {
+    unsigned int hash = 2166136261u;
+    for (; *name != '\0'; name++)
+    {
+      hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash;
+  }
+
+  std::vector<MonsterRecord> records_;
+  std::vector<int> index_;
+};
+
+// Startup is then:
+//   MonsterDatabase database;
+//   if (!database.load("monsters.cache", newestJsonTime))
+//   {
+//     MonsterLoader loader;
+//     std::string error;
+//     // ...parse each JSON record and loader.add() it...
+//     if (!loader.resolveAll(error)) reportDataError(error);
+//     database.build(loader.records());
+//     database.save("monsters.cache", newestJsonTime);
+//   }
+
+// Records are immutable once loaded. A spawner can hold a pointer to one and
+// never walk a delegation chain.
+
+
+// Copy-on-write monsters
+// A cloned Ghost copies health_ and speed_ even though most ghosts never change
+// most of their fields. With bigger records that's a lot of duplicated data.
+// Instead, an instance can point at its prototype's shared data and only store
+// the fields it has actually changed.
+
+enum MonsterField
+{
+  FIELD_HEALTH,
+  FIELD_SPEED,
+  // ...
+
+  NUM_FIELDS
+};
+
+// overridden_ below has one bit per field.
+static_assert(NUM_FIELDS <= 32, "MonsterField must fit in a 32-bit mask");
+
+// Shared by every instance spawned from the same prototype. Never modified.
+struct MonsterData
+{
+  int fields[NUM_FIELDS];
+};
+
+// Where the overridden values live. Blocks come in power-of-two sizes, one free
+// list per size, carved out of big chunks, so a monster that overrides one field
+// uses one int and one that overrides ten uses sixteen.
+class OverridePool
+{
+public:
+  OverridePool()
+  {
+    for (int i = 0; i < NUM_CLASSES; i++) free_[i] = NULL;
+  }
+
+  ~OverridePool()
+  {
+    for (size_t i = 0; i < chunks_.size(); i++) delete [] chunks_[i];
+  }
+
+  int* allocate(int sizeClass)
+  {
+    if (free_[sizeClass] == NULL) refill(sizeClass);
+
+    Block* block = free_[sizeClass];
+    free_[sizeClass] = block->next;
+    return reinterpret_cast<int*>(block);
+  }
+
+  void release(int* values, int sizeClass)
+  {
+    Block* block = reinterpret_cast<Block*>(values);
+    block->next = free_[sizeClass];
+    free_[sizeClass] = block;
+  }
+
+  // Smallest class with room for count values: 1, 2, 4, ... ints.
+  static int sizeClassFor(int count)
+  {
+    int sizeClass = 0;
+    while ((1 << sizeClass) < count) sizeClass++;
+    return sizeClass;
+  }
+
+private:
+  static const int NUM_CLASSES = 6;        // Up to 32 ints, one per field.
+  static const int CHUNK_INTS = 4096;
+
+  // A free block reuses its own memory for the list pointer, so the smallest
+  // class is really max(1 int, 1 pointer).
+  union Block
+  {
+    Block* next;
+    int value;
+  };
+
+  void refill(int sizeClass)
+  {
+    int blockInts = std::max<int>(1 << sizeClass, sizeof(Block) / sizeof(int));
+    int* chunk = new int[CHUNK_INTS];
+    chunks_.push_back(chunk);
+
+    for (int i = 0; i + blockInts <= CHUNK_INTS; i += blockInts)
+    {
+      release(chunk + i, sizeClass);
+    }
+  }
+
+  Block* free_[NUM_CLASSES];
+  std::vector<int*> chunks_;
+};
+
+class CowMonster
+{
+public:
+  CowMonster(const MonsterData* prototype)
+  : prototype_(prototype),
+    overridden_(0),
+    values_(NULL)
+  {}
+
+  int get(MonsterField field) const
+  {
+    // Fast path: the instance hasn't diverged on this field.
+    unsigned int bit = 1u << field;
+    if (!(overridden_ & bit)) return prototype_->fields[field];
+
+    return values_[slotFor(field)];
+  }
+
+  // The first write to a field is the copy. Writes after that update in place.
+  void set(OverridePool& pool, MonsterField field, int value)
+  {
+    unsigned int bit = 1u << field;
+    if (overridden_ & bit)
+    {
+      values_[slotFor(field)] = value;
+      return;
+    }
+
+    // Overridden values are kept in field order, so a field's slot is just the
+    // number of overridden fields below it. Adding one means inserting, and
+    // moving to a bigger block when this one is full.
+    int count = popcount(overridden_);
+    int slot = slotFor(field);
+
+    int* values = values_;
+    if (count == 0 || OverridePool::sizeClassFor(count + 1) != OverridePool::sizeClassFor(count))
+    {
+      values = pool.allocate(OverridePool::sizeClassFor(count + 1));
+      for (int i = 0; i < slot; i++) values[i] = values_[i];
+    }
+
+    for (int i = count; i > slot; i--) values[i] = values_[i - 1];
+    values[slot] = value;
+
+    if (values != values_ && values_ != NULL)
+    {
+      pool.release(values_, OverridePool::sizeClassFor(count));
+    }
+
+    values_ = values;
+    overridden_ |= bit;
+  }
+
+  // When the monster dies. An instance that never diverged has nothing to give back.
+  void release(OverridePool& pool)
+  {
+    if (values_ != NULL)
+    {
+      pool.release(values_, OverridePool::sizeClassFor(popcount(overridden_)));
+    }
+    values_ = NULL;
+    overridden_ = 0;
+  }
+
+private:
+  int slotFor(MonsterField field) const
+  {
+    return popcount(overridden_ & ((1u << field) - 1));
+  }
+
+  static int popcount(unsigned int bits) { return __builtin_popcount(bits); }
+
+  const MonsterData* prototype_;
+  unsigned int overridden_;   // One bit per MonsterField.
+  int* values_;               // One int per set bit, in field order.
+};
+
+// Per-instance memory is now two pointers and a mask, plus one int per field
+// the monster has actually changed. A monster that's exactly like its prototype
+// stores nothing else at all.
+
+
+// Reloading prototypes
+// When a record changes, its resolved copy is stale, and so is every record that
+// inherits from it. Change "goblin grunt" and the wizard and archer need
+// resolving again too; change "goblin archer" and nothing else does.
+// That's what MonsterLoader::reloadRecords() above does, using children_ to find
+// everything downstream of a change.
+
+// After a successful reload, the loader's records() go through
+// MonsterDatabase::build() into a new database, which is swapped in between
+// frames the same way as the breeds in TypeObject.cc. If the reload fails, the
+// game keeps the database it has until the data is fixed.
@@ -229,3 +229,565 @@ public:
   }
 };
 
+
+
+// Table-driven state machines
+// The switch version and the state-object version both put the transitions in
+// code. The static states have to be singletons, and the instantiated ones
+// new and delete on every transition.
+// But an FSM is really just data: for each state and input, which state comes
+// next and what to do on the way. Put that in a table and a transition is an
+// array lookup.
+
+enum Action
+{
+  ACTION_NONE,
+  ACTION_JUMP,
+  ACTION_DUCK,
+  ACTION_STAND,
+  ACTION_DIVE,
+
+  NUM_ACTIONS
+};
+
+struct Transition
+{
+  unsigned char next;    // A State.
+  unsigned char action;  // An Action.
+};
+
+class StateTable
+{
+public:
+  // Rows can be filled in by hand or loaded from a data file:
+  //   standing PRESS_B      -> jumping jump
+  //   standing PRESS_DOWN   -> ducking duck
+  //   jumping  PRESS_DOWN   -> diving  dive
+  //   ducking  RELEASE_DOWN -> standing stand
+  // Anything not listed stays in the same state and does nothing.
+  StateTable()
+  {
+    for (int state = 0; state < NUM_STATES; state++)
+    {
+      for (int input = 0; input < NUM_INPUTS; input++)
+      {
+        table_[state][input].next = state;
+        table_[state][input].action = ACTION_NONE;
+      }
+    }
+  }
+
+  void add(State from, Input input, State to, Action action)
+  {
+    table_[from][input].next = to;
+    table_[from][input].action = action;
+  }
+
+  const Transition& lookup(int state, Input input) const
+  {
+    return table_[state][input];
+  }
+
+private:
+  Transition table_[NUM_STATES][NUM_INPUTS];
+};
+
+// The agent doesn't own any state objects. Its state is a byte.
+struct Agent
+{
+  unsigned char state;
+  double yVelocity;
+  int chargeTime;
+  Image graphics;
+};
+
+// Actions are a switch, not a virtual call, so the whole transition is a load
+// from a table that is shared by every agent and a well-predicted jump.
+void runAction(Agent& agent, Action action)
+{
+  switch (action)
+  {
+    case ACTION_NONE:
+      break;
+
+    case ACTION_JUMP:
+      agent.yVelocity = JUMP_VELOCITY;
+      agent.graphics = IMAGE_JUMP;
+      break;
+
+    case ACTION_DUCK:
+      agent.chargeTime = 0;
+      agent.graphics = IMAGE_DUCK;
+      break;
+
+    case ACTION_STAND:
+      agent.graphics = IMAGE_STAND;
+      break;
+
+    case ACTION_DIVE:
+      agent.graphics = IMAGE_DIVE;
+      break;
+  }
+}
+
+void handleInput(const StateTable& table, Agent& agent, Input input)
+{
+  const Transition& transition = table.lookup(agent.state, input);
+  agent.state = transition.next;
+  runAction(agent, (Action)transition.action);
+}
+
+// Thousands of AI agents can share one table. Running all of their machines is
+// a loop over a flat array of Agents with no allocation anywhere.
+
+// The catch is the same one that makes FSMs limited in general: any state that
+// needs its own data (like chargeTime) has to live on the agent, whether the
+// agent is in that state or not.
+
+
+// Updating agents grouped by state
+// Heroine::update() calls state_->update() once per entity. With 50,000 NPCs
+// that's 50,000 indirect calls, jumping between different state classes in
+// whatever order the entities happen to be in.
+// Flip it around: keep one bucket per state holding the agents in that state,
+// and update a whole bucket at a time. Within a bucket there's no dispatch at all.
+
+// Ducking is the only state with an update. Its per-agent data lives in the
+// bucket, packed next to the other ducking agents' data.
+struct DuckingBucket
+{
+  std::vector<int> agents;       // Agent ids.
+  std::vector<int> chargeTime;   // Parallel to agents.
+};
+
+class StateBuckets
+{
+public:
+  void update()
+  {
+    // Standing, jumping and diving have nothing to do per frame.
+
+    // A straight loop over ints. The compiler can vectorize the increment.
+    DuckingBucket& ducking = ducking_;
+    int count = ducking.chargeTime.size();
+    for (int i = 0; i < count; i++)
+    {
+      ducking.chargeTime[i]++;
+    }
+
+    // Rare, so do it in a separate pass and keep the loop above branch-free.
+    // Same as DuckingState::update(): once past MAX_CHARGE, it bombs every frame.
+    for (int i = 0; i < count; i++)
+    {
+      if (ducking.chargeTime[i] > MAX_CHARGE)
+      {
+        superBomb(ducking.agents[i]);
+      }
+    }
+  }
+
+  // Returns the new agent's id.
+  int addAgent(State initial)
+  {
+    int agent = states_.size();
+    states_.push_back(STATE_STANDING);
+    slot_.push_back(-1);
+
+    enter(agent, initial);
+    return agent;
+  }
+
+  // A transition moves the agent from its current bucket to the new one.
+  void changeState(int agent, State to)
+  {
+    State from = (State)states_[agent];
+    if (from == to) return;
+
+    if (from == STATE_DUCKING) removeDucking(agent);
+    enter(agent, to);
+  }
+
+private:
+  void enter(int agent, State state)
+  {
+    if (state == STATE_DUCKING)
+    {
+      slot_[agent] = ducking_.agents.size();
+      ducking_.agents.push_back(agent);
+      ducking_.chargeTime.push_back(0);
+    }
+    else
+    {
+      slot_[agent] = -1;
+    }
+
+    states_[agent] = state;
+  }
+
+  // Swap-remove so the bucket stays packed.
+  void removeDucking(int agent)
+  {
+    int index = slot_[agent];
+    int last = ducking_.agents.size() - 1;
+
+    ducking_.agents[index] = ducking_.agents[last];
+    ducking_.chargeTime[index] = ducking_.chargeTime[last];
+    slot_[ducking_.agents[index]] = index;
+
+    ducking_.agents.pop_back();
+    ducking_.chargeTime.pop_back();
+  }
+
+  std::vector<unsigned char> states_;   // Current state, by agent id.
+  std::vector<int> slot_;               // Index into the agent's bucket, or -1.
+  DuckingBucket ducking_;
+};
+
+// Input handling stays table-driven as above. Instead of writing agent.state
+// directly, handleInput() calls changeState() so the agent lands in its new bucket.
+
+// Each state with an update gets its own bucket type and loop. That's the same
+// code a HeroineState subclass would have, just written for an array instead
+// of a single heroine.
+
+
+// Hierarchical and pushdown machines without allocation
+// OnGroundState -> DuckingState above works by DuckingState calling
+// OnGroundState::handleInput() by hand when it doesn't handle an input, and
+// every transition still news up a state object.
+// Both can be data instead.
+
+// Hierarchy: each state names its parent. Transitions are defined only where a
+// state actually handles an input, and UNHANDLED everywhere else.
+static const unsigned char UNHANDLED = 0xff;
+static const unsigned char NO_PARENT = 0xff;
+
+class HierarchicalTable
+{
+public:
+  // Every state starts with no parent and handles nothing, so resolve()
+  // never reads a transition nobody set.
+  HierarchicalTable()
+  {
+    for (int state = 0; state < NUM_STATES; state++)
+    {
+      parent_[state] = NO_PARENT;
+      for (int input = 0; input < NUM_INPUTS; input++)
+      {
+        own_[state][input].next = UNHANDLED;
+        own_[state][input].action = ACTION_NONE;
+      }
+    }
+  }
+
+  void setParent(int state, int parent) { parent_[state] = parent; }
+
+  void add(int state, Input input, int next, Action action)
+  {
+    own_[state][input].next = next;
+    own_[state][input].action = action;
+  }
+
+  // Walk up the hierarchy once, at load time. Afterwards every state's row
+  // already includes everything it inherits, so a state five levels deep looks
+  // up an input exactly as fast as one with no parent.
+  // Returns false if the parents loop. No chain without a loop can be longer
+  // than the number of states, so that's how we notice.
+  bool resolve()
+  {
+    for (int state = 0; state < NUM_STATES; state++)
+    {
+      int depth = 0;
+      for (int parent = parent_[state]; parent != NO_PARENT; parent = parent_[parent])
+      {
+        if (++depth >= NUM_STATES) return false;
+      }
+    }
+
+    for (int state = 0; state < NUM_STATES; state++)
+    {
+      for (int input = 0; input < NUM_INPUTS; input++)
+      {
+        int handler = state;
+        while (handler != NO_PARENT && own_[handler][input].next == UNHANDLED)
+        {
+          handler = parent_[handler];
+        }
+
+        if (handler == NO_PARENT)
+        {
+          resolved_[state][input].next = state;
+          resolved_[state][input].action = ACTION_NONE;
+        }
+        else
+        {
+          resolved_[state][input] = own_[handler][input];
+        }
+      }
+    }
+
+    return true;
+  }
+
+  const Transition& lookup(int state, Input input) const
+  {
+    return resolved_[state][input];
+  }
+
+private:
+  unsigned char parent_[NUM_STATES];
+  Transition own_[NUM_STATES][NUM_INPUTS];
+  Transition resolved_[NUM_STATES][NUM_INPUTS];
+};
+
+// Pushdown: a stack of states, so e.g. firing can push a state and pop back to
+// whatever the heroine was doing before.
+// The stack and each entry's state data live inline in the agent, sized for the
+// deepest stack we allow. Pushing and popping never allocates.
+
+// Data for the states that need some. One entry only ever holds one of these.
+union StateData
+{
+  struct { int chargeTime; } ducking;
+  struct { int shotsLeft; } firing;
+};
+
+static const unsigned char TRANSITION_PUSH = 0x80;  // Flag on Transition::next.
+static const unsigned char TRANSITION_POP  = 0xfe;
+
+// State ids share a byte with the push flag. A push of state 0x7e or 0x7f would
+// look like TRANSITION_POP or UNHANDLED, so ids have to stay below that.
+static_assert(NUM_STATES < 0x7e, "too many states for the push encoding");
+
+class PushdownAgent
+{
+public:
+  PushdownAgent(int initial)
+  : depth_(1),
+    yVelocity_(0)
+  {
+    stack_[0] = initial;
+    memset(&data_[0], 0, sizeof(StateData));
+  }
+
+  // Returns false, and changes nothing, if the transition would pop the last
+  // state or push past MAX_DEPTH. That's a bug in the table, but it shouldn't
+  // corrupt the agent in a release build.
+  bool handleInput(const HierarchicalTable& table, Input input)
+  {
+    const Transition& transition = table.lookup(stack_[depth_ - 1], input);
+
+    if (transition.next == TRANSITION_POP)
+    {
+      if (depth_ == 1) return false;
+      depth_--;
+    }
+    else if (transition.next & TRANSITION_PUSH)
+    {
+      if (depth_ == MAX_DEPTH) return false;
+      stack_[depth_] = transition.next & ~TRANSITION_PUSH;
+      memset(&data_[depth_], 0, sizeof(StateData));
+      depth_++;
+    }
+    else
+    {
+      // A plain transition replaces the top of the stack and resets its data.
+      stack_[depth_ - 1] = transition.next;
+      memset(&data_[depth_ - 1], 0, sizeof(StateData));
+    }
+
+    runAction((Action)transition.action);
+    return true;
+  }
+
+  void update()
+  {
+    if (stack_[depth_ - 1] == STATE_DUCKING)
+    {
+      if (++current().ducking.chargeTime > MAX_CHARGE) superBomb();
+    }
+  }
+
+  StateData& current() { return data_[depth_ - 1]; }
+
+private:
+  static const int MAX_DEPTH = 4;
+
+  // Same actions as the flat table, except that per-state data like the
+  // charge time lives in the entry on top of the stack, not on the agent.
+  void runAction(Action action)
+  {
+    switch (action)
+    {
+      case ACTION_NONE:
+        break;
+
+      case ACTION_JUMP:
+        yVelocity_ = JUMP_VELOCITY;
+        graphics_ = IMAGE_JUMP;
+        break;
+
+      case ACTION_DUCK:
+        current().ducking.chargeTime = 0;
+        graphics_ = IMAGE_DUCK;
+        break;
+
+      case ACTION_STAND:
+        graphics_ = IMAGE_STAND;
+        break;
+
+      case ACTION_DIVE:
+        graphics_ = IMAGE_DIVE;
+        break;
+    }
+  }
+
+  unsigned char stack_[MAX_DEPTH];
+  StateData data_[MAX_DEPTH];
+  int depth_;
+
+  double yVelocity_;
+  Image graphics_;
+};
+
+// To make ducking a substate of being on the ground:
+//   table.setParent(STATE_DUCKING, STATE_ON_GROUND);
+//   table.add(STATE_ON_GROUND, PRESS_B, STATE_JUMPING, ACTION_JUMP);
+//   table.add(STATE_DUCKING, RELEASE_DOWN, STATE_STANDING, ACTION_STAND);
+//   if (!table.resolve()) reportDataError("state parents form a loop");
+// Pressing B while ducking now jumps without DuckingState having to forward it.
+
+
+// Posting inputs from other threads
+// handleInput() has to be called on the thread that owns the heroine. Network
+// and AI threads would rather drop their inputs off and move on.
+// Give each agent a bounded multi-producer, single-consumer queue. Producers
+// post from any thread without a lock. The owning thread drains it at the
+// start of the agent's update.
+
+template <class T, unsigned int CAPACITY>
+class MpscQueue
+{
+public:
+  MpscQueue()
+  : tail_(0),
+    head_(0)
+  {
+    for (unsigned int i = 0; i < CAPACITY; i++)
+    {
+      slots_[i].sequence.store(i);
+    }
+  }
+
+  // Any thread. Returns false if the queue is full, meaning the owner has
+  // fallen a whole queue behind; the caller can drop the item or retry.
+  bool post(const T& item)
+  {
+    unsigned int position = tail_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      Slot& slot = slots_[position & MASK];
+      unsigned int sequence = slot.sequence.load(std::memory_order_acquire);
+
+      // Positions are unsigned so they wrap around instead of overflowing on
+      // a server that runs for weeks. The difference is still small, so read
+      // it back as signed to tell "behind" from "ahead".
+      int diff = (int)(sequence - position);
+
+      if (diff == 0)
+      {
+        // The slot is free for this position. Claim it.
+        if (tail_.compare_exchange_weak(position, position + 1,
+                                        std::memory_order_relaxed))
+        {
+          slot.item = item;
+          slot.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        position = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Owning thread only. Copies out up to max items posted so far, in order.
+  int drain(T* out, int max)
+  {
+    int count = 0;
+    while (count < max)
+    {
+      Slot& slot = slots_[head_ & MASK];
+      if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) break;
+
+      out[count++] = slot.item;
+      slot.sequence.store(head_ + CAPACITY, std::memory_order_release);
+      head_++;
+    }
+    return count;
+  }
+
+private:
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+  static const unsigned int MASK = CAPACITY - 1;
+
+  struct Slot
+  {
+    std::atomic<unsigned int> sequence;
+    T item;
+  };
+
+  Slot slots_[CAPACITY];
+
+  // Producers share tail_; only the owner touches head_. Keep them on
+  // separate cache lines so posting doesn't fight with draining.
+  alignas(64) std::atomic<unsigned int> tail_;
+  alignas(64) unsigned int head_;
+};
+
+// The heroine's queue is one of those holding Inputs, plus coalescing.
+class InputQueue
+{
+public:
+  bool post(Input input) { return queue_.post(input); }
+
+  // Owning thread only. Copies out everything posted so far, coalescing
+  // repeats: a producer that hammered PRESS_DOWN ten times in one frame only
+  // counts once. The order of different inputs is kept, so a press followed by
+  // a release still duck and stand.
+  int drain(Input* out, int max)
+  {
+    int count = queue_.drain(out, max);
+
+    int kept = 0;
+    for (int i = 0; i < count; i++)
+    {
+      if (kept == 0 || out[kept - 1] != out[i]) out[kept++] = out[i];
+    }
+    return kept;
+  }
+
+private:
+  MpscQueue<Input, 64> queue_;
+};
+
+// Draining at the start of update:
+void updateAgent(const StateTable& table, Agent& agent, InputQueue& queue)
+{
+  Input inputs[16];
+  int count = queue.drain(inputs, 16);
+  for (int i = 0; i < count; i++)
+  {
+    handleInput(table, agent, inputs[i]);
+  }
+
+  // Then the usual per-frame update...
+}
+
+// Inputs posted after drain() gets past them wait for next frame. That's the
+// point: within a frame, the owner sees a stable set of inputs.
@@ -207,3 +207,597 @@ protected:
 
   // Sandbox method and other operations...
 };
+
+
+// Recording effects instead of applying them
+// The provided operations above act immediately. When 10,000 powers activate in
+// one frame, that's 10,000 scattered calls into the sound engine and particle
+// system, and activate() can't run on more than one thread because they all
+// poke the same systems.
+// Since subclasses only reach the game through the provided operations, we can
+// change what those do without touching a single power: record a command
+// instead, and let each system consume its commands in one batch.
+
+struct SoundCommand
+{
+  SoundId sound;
+  double volume;
+};
+
+struct ParticleCommand
+{
+  ParticleType type;
+  int count;
+};
+
+struct MoveCommand
+{
+  double x, y, z;
+};
+
+// One per thread, so recording never needs a lock. The vectors keep their
+// capacity between frames, so after warming up recording doesn't allocate.
+struct EffectBuffer
+{
+  std::vector<SoundCommand> sounds;
+  std::vector<ParticleCommand> particles;
+  std::vector<MoveCommand> moves;
+
+  void clear()
+  {
+    sounds.clear();
+    particles.clear();
+    moves.clear();
+  }
+};
+
+class Superpower
+{
+public:
+  // The thread about to call activate() points us at its buffer.
+  static void setEffectBuffer(EffectBuffer* buffer) { buffer_ = buffer; }
+
+protected:
+  void move(double x, double y, double z)
+  {
+    MoveCommand command = { x, y, z };
+    buffer_->moves.push_back(command);
+  }
+
+  void playSound(SoundId sound, double volume)
+  {
+    SoundCommand command = { sound, volume };
+    buffer_->sounds.push_back(command);
+  }
+
+  void spawnParticles(ParticleType type, int count)
+  {
+    ParticleCommand command = { type, count };
+    buffer_->particles.push_back(command);
+  }
+
+  // Existing stuff...
+
+private:
+  static thread_local EffectBuffer* buffer_;
+};
+
+// At the end of the frame, each system gets all of its commands at once.
+// Sorting by type means the particle system sets up each emitter once and the
+// sound engine loads each sample once, instead of bouncing between them.
+void flushParticles(EffectBuffer* buffers, int numBuffers, ParticleSystem& particles)
+{
+  std::vector<ParticleCommand> all;
+  for (int i = 0; i < numBuffers; i++)
+  {
+    all.insert(all.end(), buffers[i].particles.begin(), buffers[i].particles.end());
+  }
+
+  std::stable_sort(all.begin(), all.end(),
+      [](const ParticleCommand& a, const ParticleCommand& b)
+      {
+        return a.type < b.type;
+      });
+
+  for (size_t i = 0; i < all.size(); i++)
+  {
+    particles.spawn(all[i].type, all[i].count);
+  }
+}
+
+// Sounds and moves flush the same way. Moves can't be sorted by type, but they
+// can be sorted by which hero they move, which is what the physics system wants.
+
+// The cost: a power can no longer see the result of its own effects during
+// activate(). SkyLaunch calls getHeroZ() and then move(), which is fine, but a
+// power that moved and then read the new position would see the old one.
+
+
+// Activating powers in parallel
+// With effects recorded instead of applied, the only thing left tying activate()
+// to one thread is getHeroX/Y/Z() reading live hero state that could be changing
+// under it. Take a snapshot of the hero at the start of the frame and read that.
+
+struct HeroSnapshot
+{
+  double x, y, z;
+};
+
+// Everything a power can see or touch while it runs on a worker. The snapshot
+// is shared and read-only; the effect buffer belongs to this worker.
+struct PowerContext
+{
+  const HeroSnapshot* hero;
+  EffectBuffer* effects;
+};
+
+class Superpower
+{
+public:
+  // Called by the scheduler instead of activate() directly.
+  void run(const PowerContext& context)
+  {
+    context_ = &context;
+    activate();
+    context_ = NULL;
+  }
+
+protected:
+  virtual void activate() = 0;
+
+  double getHeroX() { return context_->hero->x; }
+  double getHeroY() { return context_->hero->y; }
+  double getHeroZ() { return context_->hero->z; }
+
+  void playSound(SoundId sound, double volume)
+  {
+    SoundCommand command = { sound, volume };
+    context_->effects->sounds.push_back(command);
+  }
+
+  // move() and spawnParticles() the same way...
+
+private:
+  // Per power rather than static, so two workers never share one.
+  const PowerContext* context_;
+};
+
+// The scheduler splits the frame's powers into one contiguous chunk per worker.
+// Chunks are fixed by index, not handed out first-come-first-served, so which
+// power lands in which buffer doesn't depend on thread timing.
+class PowerScheduler
+{
+public:
+  PowerScheduler(ThreadPool& pool)
+  : pool_(pool),
+    buffers_(pool.size())
+  {}
+
+  void activateAll(Superpower** powers, int count, const HeroSnapshot& hero)
+  {
+    int workers = buffers_.size();
+    int chunk = (count + workers - 1) / workers;
+
+    for (int w = 0; w < workers; w++)
+    {
+      buffers_[w].clear();
+
+      pool_.submit([=, &hero]()
+      {
+        PowerContext context = { &hero, &buffers_[w] };
+
+        int end = std::min(count, (w + 1) * chunk);
+        for (int i = w * chunk; i < end; i++)
+        {
+          powers[i]->run(context);
+        }
+      });
+    }
+
+    pool_.wait();
+  }
+
+  // Merging walks the buffers in worker order. Since worker w always holds
+  // powers [w * chunk, (w + 1) * chunk), that's the same order the powers would
+  // have run in on one thread, no matter how many workers there are.
+  void flush(ParticleSystem& particles)
+  {
+    flushParticles(&buffers_[0], buffers_.size(), particles);
+    // Sounds and moves...
+  }
+
+private:
+  ThreadPool& pool_;
+  std::vector<EffectBuffer> buffers_;
+};
+
+// This replaces the static particles_ and the Locator as the way a power reaches
+// the outside world. Both are global, which is exactly what stops two powers from
+// running at once.
+
+
+// The particle system behind spawnParticles()
+// spawnParticles() forwards to a ParticleSystem, so here's one built to keep up
+// with a million live particles a frame.
+// 1) Fixed capacity, allocated once. No allocation per particle, ever.
+// 2) Structure of arrays: the update reads all the x's, then all the vx's,
+//    so each array is streamed through the cache in order and fits SIMD lanes.
+// 3) Live particles are always packed at the front. Killing one moves the
+//    last live particle into its place.
+
+// Where a type of particle comes from and how it moves at first. Each particle
+// gets the base velocity plus a random offset of up to spread on each axis.
+struct Emitter
+{
+  float x, y, z;
+  float vx, vy, vz;
+  float spread;
+  float lifetime;
+};
+
+class ParticleSystem
+{
+public:
+  ParticleSystem()
+  : numLive_(0)
+  {
+    // Four independent xorshift streams, one per SSE lane. Any nonzero seeds.
+    rng_ = _mm_set_epi32(0x9e3779b9, 0x7f4a7c15, 0x85ebca6b, 0xc2b2ae35);
+  }
+
+  void spawn(ParticleType type, int count)
+  {
+    // Out of room: drop the rest. Nobody notices a few missing sparkles.
+    count = std::min(count, MAX_PARTICLES - numLive_);
+
+    const Emitter& emitter = emitters_[type];
+    int begin = numLive_;
+    int end = numLive_ + count;
+
+    // New particles start at numLive_, which may not be a multiple of four,
+    // so these use unaligned stores. Four at a time, then the leftovers.
+    __m128 x = _mm_set1_ps(emitter.x);
+    __m128 y = _mm_set1_ps(emitter.y);
+    __m128 z = _mm_set1_ps(emitter.z);
+    __m128 vx = _mm_set1_ps(emitter.vx);
+    __m128 vy = _mm_set1_ps(emitter.vy);
+    __m128 vz = _mm_set1_ps(emitter.vz);
+    __m128 spread = _mm_set1_ps(emitter.spread);
+    __m128 life = _mm_set1_ps(emitter.lifetime);
+
+    int i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+      _mm_storeu_ps(&x_[i], x);
+      _mm_storeu_ps(&y_[i], y);
+      _mm_storeu_ps(&z_[i], z);
+      _mm_storeu_ps(&vx_[i], _mm_add_ps(vx, _mm_mul_ps(spread, randomSigned())));
+      _mm_storeu_ps(&vy_[i], _mm_add_ps(vy, _mm_mul_ps(spread, randomSigned())));
+      _mm_storeu_ps(&vz_[i], _mm_add_ps(vz, _mm_mul_ps(spread, randomSigned())));
+      _mm_storeu_ps(&life_[i], life);
+    }
+
+    if (i < end)
+    {
+      // Fewer than four left. Fill a full group of lanes and keep what we need.
+      alignas(16) float rx[4], ry[4], rz[4];
+      _mm_store_ps(rx, randomSigned());
+      _mm_store_ps(ry, randomSigned());
+      _mm_store_ps(rz, randomSigned());
+
+      for (int lane = 0; i < end; i++, lane++)
+      {
+        x_[i] = emitter.x;
+        y_[i] = emitter.y;
+        z_[i] = emitter.z;
+        vx_[i] = emitter.vx + emitter.spread * rx[lane];
+        vy_[i] = emitter.vy + emitter.spread * ry[lane];
+        vz_[i] = emitter.vz + emitter.spread * rz[lane];
+        life_[i] = emitter.lifetime;
+      }
+    }
+
+    numLive_ = end;
+  }
+
+  void update(float dt)
+  {
+    // Big counts get split across workers. Ranges are padded to a multiple
+    // of four so no two workers ever share an SSE lane group.
+    if (numLive_ > PARALLEL_THRESHOLD)
+    {
+      parallelFor(0, numLive_, 4, [=](int begin, int end) { integrate(begin, end, dt); });
+    }
+    else
+    {
+      integrate(0, numLive_, dt);
+    }
+
+    kill();
+  }
+
+private:
+  static const int MAX_PARTICLES = 1 << 21;
+  static const int PARALLEL_THRESHOLD = 64 * 1024;
+
+  // Four particles at a time. MAX_PARTICLES is a multiple of four, and slots
+  // past numLive_ are harmless to update, so there is no scalar tail.
+  void integrate(int begin, int end, float dt)
+  {
+    __m128 step = _mm_set1_ps(dt);
+    __m128 gravity = _mm_set1_ps(GRAVITY * dt);
+
+    for (int i = begin; i < end; i += 4)
+    {
+      __m128 vz = _mm_sub_ps(_mm_load_ps(&vz_[i]), gravity);
+      _mm_store_ps(&vz_[i], vz);
+
+      _mm_store_ps(&x_[i], _mm_add_ps(_mm_load_ps(&x_[i]), _mm_mul_ps(_mm_load_ps(&vx_[i]), step)));
+      _mm_store_ps(&y_[i], _mm_add_ps(_mm_load_ps(&y_[i]), _mm_mul_ps(_mm_load_ps(&vy_[i]), step)));
+      _mm_store_ps(&z_[i], _mm_add_ps(_mm_load_ps(&z_[i]), _mm_mul_ps(vz, step)));
+      _mm_store_ps(&life_[i], _mm_sub_ps(_mm_load_ps(&life_[i]), step));
+    }
+  }
+
+  // Four random floats in [-1, 1), one xorshift step per lane. Only shifts and
+  // xors, so plain SSE2 is enough.
+  __m128 randomSigned()
+  {
+    __m128i r = rng_;
+    r = _mm_xor_si128(r, _mm_slli_epi32(r, 13));
+    r = _mm_xor_si128(r, _mm_srli_epi32(r, 17));
+    r = _mm_xor_si128(r, _mm_slli_epi32(r, 5));
+    rng_ = r;
+
+    // Top 23 bits become the mantissa of a float in [1, 2). Shift that to [-1, 1).
+    __m128i bits = _mm_or_si128(_mm_srli_epi32(r, 9), _mm_set1_epi32(0x3f800000));
+    __m128 unit = _mm_castsi128_ps(bits);
+    return _mm_sub_ps(_mm_add_ps(unit, unit), _mm_set1_ps(3.0f));
+  }
+
+  // Serial, since it reshuffles the whole array. It still has to look at every
+  // live particle's lifetime, but it checks four at a time and skips any group
+  // where all four are alive. Moving particles around only happens for the
+  // ones that died.
+  void kill()
+  {
+    __m128 zero = _mm_setzero_ps();
+
+    int i = 0;
+    while (i < numLive_)
+    {
+      if ((i & 3) == 0 && i + 4 <= numLive_ &&
+          _mm_movemask_ps(_mm_cmple_ps(_mm_load_ps(&life_[i]), zero)) == 0)
+      {
+        i += 4;
+        continue;
+      }
+
+      if (life_[i] > 0)
+      {
+        i++;
+        continue;
+      }
+
+      // Don't advance i: the particle we moved in hasn't been checked yet.
+      int last = --numLive_;
+      x_[i] = x_[last];
+      y_[i] = y_[last];
+      z_[i] = z_[last];
+      vx_[i] = vx_[last];
+      vy_[i] = vy_[last];
+      vz_[i] = vz_[last];
+      life_[i] = life_[last];
+    }
+  }
+
+  __m128i rng_;
+  int numLive_;
+
+  alignas(16) float x_[MAX_PARTICLES];
+  alignas(16) float y_[MAX_PARTICLES];
+  alignas(16) float z_[MAX_PARTICLES];
+  alignas(16) float vx_[MAX_PARTICLES];
+  alignas(16) float vy_[MAX_PARTICLES];
+  alignas(16) float vz_[MAX_PARTICLES];
+  alignas(16) float life_[MAX_PARTICLES];
+
+  Emitter emitters_[NUM_PARTICLE_TYPES];
+};
+
+// That's about 56MB for two million particles, so it belongs on the heap,
+// created once at startup, not on the stack.
+
+// The "particles" suite in Benchmarks.cc times this with a million live
+// particles: one integrate-and-kill frame per operation, next to the same update
+// over an array of Particle structs. The SoA version should be bound by memory
+// bandwidth: 28 bytes read and written per particle per frame.
+
+
+// The mixer behind playSound()
+// playSound() calls soundEngine_.play() right there in gameplay code. If the
+// audio system is busy, gameplay waits.
+// Instead, playSound() just posts a request. The mixer runs on its own thread,
+// picks up requests, and mixes the voices that are playing into an output buffer.
+
+// Where mixed blocks go. The real one hands them to the sound card and blocks
+// until it has room, which is what paces the mixer thread. A test can use one
+// that just keeps the samples.
+class AudioOutput
+{
+public:
+  virtual ~AudioOutput() {}
+  virtual void write(const float* samples, int frames) = 0;
+};
+
+struct PlayRequest
+{
+  SoundId sound;
+  float volume;
+  int priority;
+};
+
+class Mixer
+{
+public:
+  Mixer()
+  : numVoices_(0),
+    running_(false)
+  {}
+
+  ~Mixer() { stop(); }
+
+  // Starts the mixer thread. It's the only thread that ever waits on the
+  // audio device; gameplay only ever touches the request queue.
+  void start(AudioOutput& output)
+  {
+    running_ = true;
+    thread_ = std::thread([this, &output]()
+    {
+      float block[BLOCK_FRAMES];
+      while (running_.load(std::memory_order_relaxed))
+      {
+        mix(block, BLOCK_FRAMES);
+        output.write(block, BLOCK_FRAMES);
+      }
+    });
+  }
+
+  void stop()
+  {
+    running_ = false;
+    if (thread_.joinable()) thread_.join();
+  }
+
+  // Any gameplay thread. Never blocks. If the queue is full the request is
+  // dropped: a missing sound is better than a hitch.
+  void play(SoundId sound, float volume, int priority)
+  {
+    PlayRequest request = { sound, volume, priority };
+    requests_.post(request);
+  }
+
+  // Mixer thread, once per audio block. Doesn't care whether the output goes
+  // to the sound card or to a buffer in a test, so mixing can be checked offline
+  // by calling this directly, without start(), and comparing samples.
+  void mix(float* out, int frames)
+  {
+    takeRequests();
+
+    memset(out, 0, frames * sizeof(float));
+    for (int v = 0; v < numVoices_; v++)
+    {
+      Voice& voice = voices_[v];
+      const float* samples = voice.sample->data;
+      int remaining = voice.sample->length - voice.position;
+      int count = std::min(frames, remaining);
+
+      for (int i = 0; i < count; i++)
+      {
+        out[i] += samples[voice.position + i] * voice.volume;
+      }
+      voice.position += count;
+    }
+
+    // Finished voices go back to the pool. Swap-remove keeps the live ones packed.
+    for (int v = 0; v < numVoices_; )
+    {
+      if (voices_[v].position >= voices_[v].sample->length)
+      {
+        voices_[v] = voices_[--numVoices_];
+      }
+      else
+      {
+        v++;
+      }
+    }
+  }
+
+private:
+  static const int MAX_VOICES = 32;
+  static const int MAX_REQUESTS = 256;
+  static const int BLOCK_FRAMES = 512;   // About 10ms at 48kHz.
+
+  struct Voice
+  {
+    const Sample* sample;
+    SoundId sound;
+    int position;
+    float volume;
+    int priority;
+  };
+
+  void takeRequests()
+  {
+    PlayRequest requests[MAX_REQUESTS];
+    int count = requests_.drain(requests, MAX_REQUESTS);
+
+    for (int i = 0; i < count; i++)
+    {
+      // Ten powers firing the same sound in one frame should sound like one
+      // loud sound, not ten voices stacked on top of each other.
+      if (mergeDuplicate(requests[i])) continue;
+      startVoice(requests[i]);
+    }
+  }
+
+  // Only voices that haven't started playing yet count as the same trigger.
+  bool mergeDuplicate(const PlayRequest& request)
+  {
+    for (int v = 0; v < numVoices_; v++)
+    {
+      Voice& voice = voices_[v];
+      if (voice.sound == request.sound && voice.position == 0)
+      {
+        voice.volume = std::max(voice.volume, request.volume);
+        voice.priority = std::max(voice.priority, request.priority);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void startVoice(const PlayRequest& request)
+  {
+    int v = numVoices_;
+    if (numVoices_ == MAX_VOICES)
+    {
+      // Out of voices: steal the least important one, but only if the new
+      // sound matters more.
+      v = 0;
+      for (int i = 1; i < numVoices_; i++)
+      {
+        if (voices_[i].priority < voices_[v].priority) v = i;
+      }
+      if (voices_[v].priority >= request.priority) return;
+    }
+    else
+    {
+      numVoices_++;
+    }
+
+    voices_[v].sample = loadedSample(request.sound);
+    voices_[v].sound = request.sound;
+    voices_[v].position = 0;
+    voices_[v].volume = request.volume;
+    voices_[v].priority = request.priority;
+  }
+
+  // The same bounded multi-producer, single-consumer queue the heroine's
+  // InputQueue in State.cc is built on, holding PlayRequests. No coalescing
+  // here; mergeDuplicate() handles that.
+  MpscQueue<PlayRequest, MAX_REQUESTS> requests_;
+
+  // Only the mixer thread touches these.
+  Voice voices_[MAX_VOICES];
+  int numVoices_;
+
+  std::atomic<bool> running_;
+  std::thread thread_;
+};
+
+// The provided operation just forwards, as before:
+void playSound(SoundId sound, double volume)
+{
+  mixer_.play(sound, volume, PRIORITY_NORMAL);
+}
@@ -1,4 +1,342 @@
 // TypeObject
 // Definition:
-// 
-//
\ No newline at end of file
+// Define a type object class and a typed object class. 
+// Each type object instance represents a different logical type. 
+// Each typed object stores a reference to the type object that describes its type.
+
+// Instance-specific data is stored in the typed object instance, 
+// and data or behavior that should be shared across all instances of the same conceptual type is stored in the type object.
+
+// Example: instead of a Monster subclass for every kind of monster
+// (Dragon, Troll, Skeleton patrolling between 0 and 100...), there is one Monster
+// class and a Breed that says what kind of monster it is.
+
+// Because breeds are data, new kinds of monster can be added without touching code.
+// They can be loaded from a file:
+
+{
+  "skeleton": {
+    "health": 20,
+    "attack": "The skeleton rattles at you!",
+    "patrolLow": 0,
+    "patrolHigh": 100
+  },
+  "troll": {
+    "health": 48,
+    "attack": "The troll clubs you!",
+    "patrolLow": 0,
+    "patrolHigh": 40
+  }
+}
+
+// The breed. Everything monsters of one kind share.
+// The fields a monster reads every frame are packed together so a table of
+// breeds is dense. The attack string is only read when the monster attacks, so
+// it lives somewhere else.
+struct Breed
+{
+  int health;
+  float patrolLow;
+  float patrolHigh;
+  int attackText;   // Index into the registry's string table.
+};
+
+// All of the breeds live in one contiguous table, and a monster refers to its
+// breed by index. Two bytes instead of an eight byte pointer, and monsters of
+// every breed read their shared data from the same few cache lines.
+typedef unsigned short BreedId;
+
+// Returned by find() for a name that isn't a breed. Never a real index.
+static const BreedId INVALID_BREED = 0xffff;
+
+class BreedRegistry
+{
+public:
+  // Reads the file above at startup. After that, the table only changes
+  // through reload(), which never removes or reorders a breed, so every
+  // BreedId stays valid for as long as the game runs.
+  // Returns false if the data is bad, with the reason in error.
+  bool load(const char* path, std::string& error)
+  {
+    JsonValue root = parseJsonFile(path);
+    for (JsonValue::Member member : root.members())
+    {
+      // A BreedId is two bytes, and INVALID_BREED is taken.
+      if (breeds_.size() >= INVALID_BREED)
+      {
+        error = "too many breeds in " + std::string(path);
+        return false;
+      }
+
+      Breed breed;
+      breed.health = member.value["health"].asInt();
+      breed.patrolLow = member.value["patrolLow"].asFloat();
+      breed.patrolHigh = member.value["patrolHigh"].asFloat();
+      breed.attackText = strings_.size();
+      strings_.push_back(member.value["attack"].asString());
+
+      ids_[member.name] = (BreedId)breeds_.size();
+      breeds_.push_back(breed);
+    }
+    return true;
+  }
+
+  // Name lookups are for load time and spawning, not the update loop.
+  // A misspelled name in data gives INVALID_BREED; the caller reports it.
+  BreedId find(const std::string& name) const
+  {
+    auto found = ids_.find(name);
+    if (found == ids_.end()) return INVALID_BREED;
+    return found->second;
+  }
+
+  // Applies an edited file. Breeds that already exist are updated in place, by
+  // name, and new ones are appended. A breed deleted from the file just stays
+  // in the table until the next restart.
+  // The whole file is checked before anything changes, so bad data leaves
+  // the registry exactly as it was.
+  bool reload(const char* path, std::string& error)
+  {
+    struct Parsed
+    {
+      std::string name;
+      Breed breed;
+      std::string attack;
+    };
+
+    std::vector<Parsed> parsed;
+    int added = 0;
+
+    JsonValue root = parseJsonFile(path);
+    for (JsonValue::Member member : root.members())
+    {
+      Parsed entry;
+      entry.name = member.name;
+      entry.breed.health = member.value["health"].asInt();
+      entry.breed.patrolLow = member.value["patrolLow"].asFloat();
+      entry.breed.patrolHigh = member.value["patrolHigh"].asFloat();
+      entry.attack = member.value["attack"].asString();
+      parsed.push_back(entry);
+
+      if (ids_.find(entry.name) == ids_.end()) added++;
+    }
+
+    if (breeds_.size() + added >= INVALID_BREED)
+    {
+      error = "too many breeds in " + std::string(path);
+      return false;
+    }
+
+    for (size_t i = 0; i < parsed.size(); i++)
+    {
+      auto found = ids_.find(parsed[i].name);
+      if (found != ids_.end())
+      {
+        Breed& breed = breeds_[found->second];
+        int attackText = breed.attackText;
+        breed = parsed[i].breed;
+        breed.attackText = attackText;
+        strings_[attackText] = parsed[i].attack;
+      }
+      else
+      {
+        Breed breed = parsed[i].breed;
+        breed.attackText = strings_.size();
+        strings_.push_back(parsed[i].attack);
+
+        ids_[parsed[i].name] = (BreedId)breeds_.size();
+        breeds_.push_back(breed);
+      }
+    }
+
+    return true;
+  }
+
+  const Breed& get(BreedId id) const { return breeds_[id]; }
+
+  const char* getAttack(BreedId id) const
+  {
+    return strings_[breeds_[id].attackText].c_str();
+  }
+
+private:
+  std::vector<Breed> breeds_;
+  std::vector<std::string> strings_;
+  std::unordered_map<std::string, BreedId> ids_;
+};
+
+// The typed object. No subclasses and no virtual methods, just the instance
+// data and which breed it is.
+class Monster
+{
+public:
+  Monster(const BreedRegistry& registry, BreedId breed)
+  : breed_(breed),
+    health_(registry.get(breed).health),
+    x_(registry.get(breed).patrolLow),
+    patrollingLeft_(false)
+  {}
+
+  // What Skeleton::update() did, with the bounds coming from the breed
+  // instead of being hard-coded.
+  void update(const BreedRegistry& registry, double elapsed)
+  {
+    const Breed& breed = registry.get(breed_);
+
+    if (patrollingLeft_)
+    {
+      x_ -= elapsed;
+      if (x_ <= breed.patrolLow)
+      {
+        patrollingLeft_ = false;
+        x_ = breed.patrolLow + (breed.patrolLow - x_);
+      }
+    }
+    else
+    {
+      x_ += elapsed;
+      if (x_ >= breed.patrolHigh)
+      {
+        patrollingLeft_ = true;
+        x_ = breed.patrolHigh - (x_ - breed.patrolHigh);
+      }
+    }
+  }
+
+  const char* getAttack(const BreedRegistry& registry)
+  {
+    return registry.getAttack(breed_);
+  }
+
+private:
+  BreedId breed_;
+  int health_;   // Current health. Starts at the breed's.
+  float x_;
+  bool patrollingLeft_;
+};
+
+// Spawning is then just:
+BreedRegistry breeds;
+std::string error;
+if (!breeds.load("breeds.json", error)) reportDataError(error);
+
+BreedId skeletonBreed = breeds.find("skeleton");
+if (skeletonBreed != INVALID_BREED)
+{
+  Monster skeleton(breeds, skeletonBreed);
+}
+
+// Keeping monsters sorted by breed when updating them in bulk means consecutive
+// monsters read the same Breed, which is already in cache.
+
+// Like the Flyweight pattern, shared data is split out of the instances.
+// The difference is the intent: Flyweight is about saving memory, Type Object is
+// about organizing types as data.
+
+
+// Reloading breeds while the game runs
+// Breeds are data, but load() only runs at startup, so tuning a number still
+// means restarting the game.
+// A reload service watches the data files. When one changes, it re-parses just
+// that file on a background thread and hands the result to the game to swap in
+// between frames.
+
+class FileWatcher
+{
+public:
+  void watch(const char* path)
+  {
+    WatchedFile file = { path, modifiedTime(path) };
+    files_.push_back(file);
+  }
+
+  // Polled from the reload thread a few times a second. Returns the files
+  // whose modification time changed since the last poll.
+  std::vector<std::string> poll()
+  {
+    std::vector<std::string> changed;
+    for (size_t i = 0; i < files_.size(); i++)
+    {
+      long time = modifiedTime(files_[i].path.c_str());
+      if (time != files_[i].time)
+      {
+        files_[i].time = time;
+        changed.push_back(files_[i].path);
+      }
+    }
+    return changed;
+  }
+
+private:
+  struct WatchedFile
+  {
+    std::string path;
+    long time;
+  };
+
+  std::vector<WatchedFile> files_;
+};
+
+// Monsters hold a BreedId, not a pointer, so the breed table can be replaced
+// without touching a single live monster. The game reads breeds through a
+// pointer that only changes at the start of a frame.
+class BreedReloader
+{
+public:
+  // The reloader keeps a copy of its own to apply edits to. The game's copy
+  // is never touched by the reload thread.
+  BreedReloader(const BreedRegistry& initial)
+  : current_(new BreedRegistry(initial)),
+    latest_(initial),
+    pending_(NULL)
+  {}
+
+  ~BreedReloader()
+  {
+    delete pending_.exchange(NULL);
+    delete current_;
+  }
+
+  // Reload thread. Applies the edit to latest_, which has every edit so far,
+  // then publishes a copy of it. The game keeps using its current registry
+  // while this runs, so the loop never stalls on parsing.
+  // Two reloads before the game swaps are fine: the second copy is taken from
+  // latest_, so it already includes the first.
+  bool reload(const char* path, std::string& error)
+  {
+    // reload() checks the file before changing anything, so on failure
+    // latest_ is still the last good data.
+    if (!latest_.reload(path, error)) return false;
+
+    // If the game hasn't picked up the last one yet, this one replaces it.
+    delete pending_.exchange(new BreedRegistry(latest_));
+    return true;
+  }
+
+  // Game thread, between frames. Swapping a pointer is all it costs.
+  void swapIfReady()
+  {
+    BreedRegistry* next = pending_.exchange(NULL);
+    if (next == NULL) return;
+
+    // Safe to free: nothing holds on to a Breed& across frames, and the
+    // reload thread never reads current_.
+    delete current_;
+    current_ = next;
+  }
+
+  // Game thread only.
+  const BreedRegistry& current() const { return *current_; }
+
+private:
+  BreedRegistry* current_;               // Game thread only.
+  BreedRegistry latest_;                 // Reload thread only.
+  std::atomic<BreedRegistry*> pending_;  // Handed from one to the other.
+};
+
+// Monsters hold a BreedId, and reload() never removes or reorders a breed, so
+// every id a live monster holds still means the same breed after the swap.
+
+// Monster prototypes (Prototype.cc) and spell bytecode (ByteCode.cc) reload the
+// same way, through the same watcher and the same swap between frames. What's
+// different is how much has to be redone when one file changes; see those files.